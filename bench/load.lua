@@ -0,0 +1,175 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- HTTP load generator.  Keeps `connections` connections open, each with up
+-- to `pipeline` requests in flight, for `duration` milliseconds and records
+-- the latency of every response.
+
+local uv = require('uv')
+local tls = require('tls')
+local decoder = require('http-codec').decoder
+
+local sub = string.sub
+
+-- Plain tcp connections use uv directly so the generator stays cheap
+local function connectTcp(options, onConnect, onData, onError)
+  local handle = uv.new_tcp()
+  uv.tcp_connect(handle, options.host, options.port, function (err)
+    if err then return onError(err) end
+    uv.tcp_nodelay(handle, true)
+    uv.read_start(handle, function (err, chunk)
+      if err then return onError(err) end
+      onData(chunk)
+    end)
+    onConnect()
+  end)
+  return {
+    write = function (data)
+      uv.write(handle, data)
+    end,
+    close = function ()
+      if not uv.is_closing(handle) then uv.close(handle) end
+    end,
+  }
+end
+
+local function connectTls(options, onConnect, onData, onError)
+  local socket = tls.connect({
+    host = options.host,
+    port = options.port,
+    rejectUnauthorized = false,
+  }, onConnect)
+  socket:on('data', onData)
+  socket:on('end', function () onData(nil) end)
+  socket:on('error', onError)
+  return {
+    write = function (data)
+      socket:write(data)
+    end,
+    close = function ()
+      socket:destroy()
+    end,
+  }
+end
+
+-- options: host, port, connections, pipeline, duration, keepAlive, tls
+-- callback(stats) with stats.requests, stats.errors, stats.elapsed (ms) and
+-- stats.latencies (ms, unsorted)
+return function (options, callback)
+  local connect = options.tls and connectTls or connectTcp
+  local keepAlive = options.keepAlive ~= false
+  local pipeline = keepAlive and (options.pipeline or 1) or 1
+
+  local request = "GET / HTTP/1.1\r\nHost: " .. options.host .. "\r\n" ..
+    (keepAlive and "" or "Connection: close\r\n") .. "\r\n"
+
+  local latencies = {}
+  local requests, errors = 0, 0
+  local running = true
+  local open = {}
+  local start = uv.hrtime()
+
+  local startConnection
+
+  function startConnection()
+    local decode = decoder()
+    local buffer, index = "", 1
+    -- Send times of the requests in flight, oldest first
+    local sent, first, last = {}, 1, 0
+    local conn, closed
+
+    local function send(count)
+      local now = uv.hrtime()
+      for _ = 1, count do
+        last = last + 1
+        sent[last] = now
+      end
+      conn.write(count == 1 and request or string.rep(request, count))
+    end
+
+    local function finish()
+      if closed then return end
+      closed = true
+      open[conn] = nil
+      conn.close()
+      if running then startConnection() end
+    end
+
+    local function onResponse(head)
+      if head.code ~= 200 then errors = errors + 1 end
+    end
+
+    local function onDone()
+      requests = requests + 1
+      latencies[requests] = (uv.hrtime() - sent[first]) / 1e6
+      sent[first] = nil
+      first = first + 1
+      if not keepAlive then return finish() end
+      if running then send(1) end
+    end
+
+    local function onData(chunk)
+      if not chunk then return finish() end
+      if index > #buffer then
+        buffer, index = chunk, 1
+      else
+        buffer, index = sub(buffer, index) .. chunk, 1
+      end
+      while true do
+        local event, nextIndex = decode(buffer, index)
+        if event == nil then break end
+        index = nextIndex
+        if type(event) == "table" then
+          onResponse(event)
+        elseif #event == 0 then
+          onDone()
+          if not running or not keepAlive then break end
+        end
+      end
+    end
+
+    local function onError()
+      errors = errors + 1
+      finish()
+    end
+
+    conn = connect(options, function ()
+      if running then send(pipeline) end
+    end, onData, onError)
+    open[conn] = true
+  end
+
+  for _ = 1, options.connections or 1 do
+    startConnection()
+  end
+
+  local stopper = uv.new_timer()
+  uv.timer_start(stopper, options.duration or 5000, 0, function ()
+    uv.close(stopper)
+    running = false
+    for conn in pairs(open) do
+      conn.close()
+    end
+    callback({
+      requests = requests,
+      errors = errors,
+      elapsed = (uv.hrtime() - start) / 1e6,
+      latencies = latencies,
+    })
+  end)
+end
@@ -0,0 +1,164 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- Localhost HTTP benchmark suite.
+--
+-- Usage: luvit bench/run.lua [options] [scenario...]
+--
+--   -c, --connections N   concurrent connections (default 50)
+--   -p, --pipeline N      requests in flight per connection (default 1)
+--   -d, --duration S      seconds per scenario (default 5)
+--   -k, --no-keepalive    use a new connection for every request
+--   --port N              port for the server (default 18080)
+--
+-- Scenarios are http, codec and tls, all of them by default.  Each server
+-- runs in its own luvit process so the load generator doesn't skew it.
+
+local uv = require('uv')
+local pathJoin = require('luvi').path.join
+local load = require('./load')
+
+local scenarios = { "http", "codec", "tls" }
+
+local options = {
+  host = "127.0.0.1",
+  port = 18080,
+  connections = 50,
+  pipeline = 1,
+  duration = 5000,
+  keepAlive = true,
+}
+
+local selected = {}
+local argv = process.argv
+local i = 2
+while argv[i] do
+  local arg = argv[i]
+  if arg == "-c" or arg == "--connections" then
+    i = i + 1
+    options.connections = tonumber(argv[i])
+  elseif arg == "-p" or arg == "--pipeline" then
+    i = i + 1
+    options.pipeline = tonumber(argv[i])
+  elseif arg == "-d" or arg == "--duration" then
+    i = i + 1
+    options.duration = tonumber(argv[i]) * 1000
+  elseif arg == "-k" or arg == "--no-keepalive" then
+    options.keepAlive = false
+  elseif arg == "--port" then
+    i = i + 1
+    options.port = tonumber(argv[i])
+  else
+    selected[#selected + 1] = arg
+  end
+  i = i + 1
+end
+if #selected == 0 then selected = scenarios end
+
+local function percentile(sorted, q)
+  if #sorted == 0 then return 0 end
+  return sorted[math.max(1, math.ceil(q * #sorted))]
+end
+
+-- Start the server process and call onReady(stop) once it's listening.
+-- stop(callback) shuts it down and calls callback(allocatedBytes) once the
+-- process exited and its output was read.
+local function startServer(scenario, onReady, onFail)
+  local stdin = uv.new_pipe(false)
+  local stdout = uv.new_pipe(false)
+  local ready, allocated, onStopped
+  local pending = 2 -- process exit and end of stdout
+
+  local function done()
+    pending = pending - 1
+    if pending > 0 then return end
+    if not ready then return onFail() end
+    if onStopped then onStopped(allocated) end
+  end
+
+  local child
+  child = uv.spawn(uv.exepath(), {
+    args = { pathJoin(module.dir, "server.lua"), scenario, tostring(options.port) },
+    stdio = { stdin, stdout, 2 },
+  }, function ()
+    uv.close(child)
+    done()
+  end)
+
+  local function stop(callback)
+    onStopped = callback
+    uv.close(stdin)
+  end
+
+  local buffer = ""
+  uv.read_start(stdout, function (err, chunk)
+    assert(not err, err)
+    if not chunk then
+      uv.close(stdout)
+      return done()
+    end
+    buffer = buffer .. chunk
+    for line in buffer:gmatch("([^\n]*)\n") do
+      if line == "ready" then
+        ready = true
+        onReady(stop)
+      else
+        allocated = tonumber(line:match("^alloc (%d+)")) or allocated
+      end
+    end
+    buffer = buffer:match("[^\n]*$")
+  end)
+end
+
+local function report(scenario, stats, allocated)
+  local latencies = stats.latencies
+  table.sort(latencies)
+  print(string.format("%-8s %10.0f %9.2f %9.2f %9.2f %10.1f %7d",
+    scenario,
+    stats.requests / (stats.elapsed / 1000),
+    percentile(latencies, 0.5),
+    percentile(latencies, 0.99),
+    percentile(latencies, 0.999),
+    (allocated or 0) / (1024 * 1024),
+    stats.errors))
+end
+
+print(string.format("connections=%d pipeline=%d duration=%gs keepalive=%s",
+  options.connections, options.pipeline, options.duration / 1000,
+  tostring(options.keepAlive)))
+print(string.format("%-8s %10s %9s %9s %9s %10s %7s",
+  "scenario", "req/s", "p50 ms", "p99 ms", "p999 ms", "alloc MB", "errors"))
+
+local function runNext(index)
+  local scenario = selected[index]
+  if not scenario then return end
+  startServer(scenario, function (stop)
+    options.tls = scenario == "tls"
+    load(options, function (stats)
+      stop(function (allocated)
+        report(scenario, stats, allocated)
+        runNext(index + 1)
+      end)
+    end)
+  end, function ()
+    print(string.format("%-8s server failed to start", scenario))
+    runNext(index + 1)
+  end)
+end
+
+runNext(1)
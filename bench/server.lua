@@ -0,0 +1,132 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+-- Server side of the benchmark, started by run.lua as a child process.
+-- Usage: luvit bench/server.lua <scenario> <port>
+--
+-- Prints "ready" once listening.  When stdin closes it prints
+-- "alloc <bytes>" with the bytes the lua heap grew by while serving
+-- (sampled once per loop iteration) and exits.
+
+local uv = require('uv')
+local pathJoin = require('luvi').path.join
+local codec = require('http-codec')
+
+local scenario, port = process.argv[2], tonumber(process.argv[3])
+local HOST = "127.0.0.1"
+local body = "Hello World\n"
+
+local function onRequest(_, res)
+  res:setHeader("Content-Type", "text/plain")
+  res:setHeader("Content-Length", #body)
+  res:finish(body)
+end
+
+local scenarios = {}
+
+-- The full http module stack: net.Socket, streams, ServerResponse
+function scenarios.http(onListen)
+  require('http').createServer(onRequest):listen(port, HOST, onListen)
+end
+
+-- http-codec on raw uv handles without streams
+function scenarios.codec(onListen)
+  local response = {
+    code = 200,
+    { "Content-Type", "text/plain" },
+    { "Content-Length", #body },
+  }
+  local server = uv.new_tcp()
+  uv.tcp_bind(server, HOST, port)
+  uv.listen(server, 1024, function (err)
+    assert(not err, err)
+    local client = uv.new_tcp()
+    uv.accept(server, client)
+    local decode = codec.decoder()
+    local encode = codec.encoder()
+    local buffer, index = "", 1
+    uv.read_start(client, function (err, chunk)
+      if err or not chunk then
+        return uv.close(client)
+      end
+      if index > #buffer then
+        buffer, index = chunk, 1
+      else
+        buffer, index = buffer:sub(index) .. chunk, 1
+      end
+      local out = {}
+      local keepAlive = true
+      while true do
+        local event, nextIndex = decode(buffer, index)
+        if event == nil then break end
+        index = nextIndex
+        if type(event) == "table" then
+          keepAlive = event.keepAlive
+          out[#out + 1] = encode(response)
+          out[#out + 1] = encode(body)
+        end
+      end
+      if #out > 0 then
+        uv.write(client, out)
+      end
+      if not keepAlive then
+        uv.shutdown(client, function ()
+          uv.close(client)
+        end)
+      end
+    end)
+  end)
+  onListen()
+end
+
+-- The http module over tls
+function scenarios.tls(onListen)
+  local examples = pathJoin(module.dir, "..", "examples")
+  local fs = require('fs')
+  require('https').createServer({
+    key = fs.readFileSync(pathJoin(examples, "key.pem")),
+    cert = fs.readFileSync(pathJoin(examples, "cert.pem")),
+  }, onRequest):listen(port, HOST, onListen)
+end
+
+local start = assert(scenarios[scenario], "Unknown scenario " .. tostring(scenario))
+
+-- Sum of the heap growth between loop iterations.  Memory freed by the
+-- collector in the middle of an iteration is not seen, so this is a lower
+-- bound of what was allocated.
+local allocated = 0
+local last = collectgarbage("count")
+local sampler = uv.new_check()
+uv.check_start(sampler, function ()
+  local now = collectgarbage("count")
+  if now > last then
+    allocated = allocated + (now - last)
+  end
+  last = now
+end)
+uv.unref(sampler)
+
+start(function ()
+  print("ready")
+end)
+
+process.stdin:on('end', function ()
+  print("alloc " .. math.floor(allocated * 1024))
+  process:exit(0)
+end)
+process.stdin:resume()
@@ -17,7 +17,7 @@ limitations under the License.
 --]]
 --[[lit-meta
   name = "luvit/buffer"
-  version = "2.1.2"
+  version = "2.5.0"
   dependencies = {
     "luvit/core@2.0.0"
   }
@@ -37,6 +37,7 @@ ffi.cdef[[
   void *malloc (size_t __size);
   void *calloc (size_t nmemb, size_t __size);
   void free (void *__ptr);
+  void *memmove (void *__dest, const void *__src, size_t __n);
 ]]
 
 local buffer = {}
@@ -91,9 +92,16 @@ function Buffer.meta:__index(key)
   return Buffer[key]
 end
 
+-- Buffers over read-only memory (like file mappings) set readOnly, since
+-- storing into them would crash the process instead of raising an error.
+local function checkWritable(self)
+  if self.readOnly then error("Buffer is read-only") end
+end
+
 function Buffer.meta:__newindex(key, value)
   if type(key) == "number" then
     if key < 1 or key > self.length then error("Index out of bounds") end
+    checkWritable(self)
     self.ctype[key - 1] = value
     return
   end
@@ -120,96 +128,268 @@ function Buffer:readInt8(offset)
   return complement8(self[offset])
 end
 
-local function complement16(value)
-  return value < 0x8000 and value or value - 0x10000
+function Buffer:writeUInt8(offset, value)
+  self[offset] = value
 end
 
-function Buffer:readUInt16LE(offset)
-  return bit.lshift(self[offset + 1], 8) +
-                    self[offset]
+function Buffer:writeInt8(offset, value)
+  return self:writeUInt8(offset, value)
 end
 
-function Buffer:readUInt16BE(offset)
-  return bit.lshift(self[offset], 8) +
-                    self[offset + 1]
+-- Multi-byte values go through a scratch union: one bounds check, one copy
+-- (which the JIT turns into a single unaligned load or store) and a byte
+-- swap when the requested order isn't the host's.
+local scratch = ffi.new([[union {
+  uint16_t u16; int16_t i16;
+  uint32_t u32; int32_t i32;
+  uint64_t u64; int64_t i64;
+  float f; double d;
+}]])
+
+local bswap, rshift = bit.bswap, bit.rshift
+
+local function swap2(s) s.u16 = rshift(bswap(s.u16), 16) end
+local function swap4(s) s.i32 = bswap(s.i32) end
+local function swap8(s) s.i64 = bswap(s.i64) end
+local swaps = { [2] = swap2, [4] = swap4, [8] = swap8 }
+
+local hostLE = ffi.abi("le")
+
+local function checkRange(self, offset, size)
+  if offset < 1 or offset + size - 1 > self.length then
+    error("Index out of bounds")
+  end
 end
 
-function Buffer:readInt16LE(offset)
-  return complement16(self:readUInt16LE(offset))
+local function reader(size, field, littleEndian)
+  local swap = littleEndian ~= hostLE and swaps[size]
+  return function (self, offset)
+    checkRange(self, offset, size)
+    ffi.copy(scratch, self.ctype + offset - 1, size)
+    if swap then swap(scratch) end
+    return scratch[field]
+  end
 end
 
-function Buffer:readInt16BE(offset)
-  return complement16(self:readUInt16BE(offset))
+local function writer(size, field, littleEndian)
+  local swap = littleEndian ~= hostLE and swaps[size]
+  return function (self, offset, value)
+    checkRange(self, offset, size)
+    checkWritable(self)
+    scratch[field] = value
+    if swap then swap(scratch) end
+    ffi.copy(self.ctype + offset - 1, scratch, size)
+  end
 end
 
-function Buffer:readUInt32LE(offset)
-  return self[offset + 3] * 0x1000000 +
-         bit.lshift(self[offset + 2], 16) +
-         bit.lshift(self[offset + 1], 8) +
-                    self[offset]
+-- 64-bit integers are read as uint64_t / int64_t cdata, and may be written
+-- as numbers or cdata.
+for name, spec in pairs({
+  UInt16 = { 2, "u16" }, Int16 = { 2, "i16" },
+  UInt32 = { 4, "u32" }, Int32 = { 4, "i32" },
+  UInt64 = { 8, "u64" }, Int64 = { 8, "i64" },
+  Float = { 4, "f" }, Double = { 8, "d" },
+}) do
+  local size, field = spec[1], spec[2]
+  Buffer["read" .. name .. "LE"] = reader(size, field, true)
+  Buffer["read" .. name .. "BE"] = reader(size, field, false)
+  Buffer["write" .. name .. "LE"] = writer(size, field, true)
+  Buffer["write" .. name .. "BE"] = writer(size, field, false)
 end
 
-function Buffer:readUInt32BE(offset)
-  return self[offset] * 0x1000000 +
-         bit.lshift(self[offset + 1], 16) +
-         bit.lshift(self[offset + 2], 8) +
-                    self[offset + 3]
+function Buffer:toString(i, j)
+  local offset = i and i - 1 or 0
+  if (offset < 0 or offset > self.length) or (j and j > self.length) then error("Range out of bounds") end
+  return ffi.string(self.ctype + offset, (j or self.length) - offset)
 end
 
-function Buffer:readInt32LE(offset)
-  return bit.tobit(self:readUInt32LE(offset))
+function Buffer.isBuffer(b)
+  return instanceof(b, Buffer)
 end
 
-function Buffer:readInt32BE(offset)
-  return bit.tobit(self:readUInt32BE(offset))
+-- Resolve 1-based inclusive i, j like toString does, defaulting to the whole
+-- buffer.  Returns the 0-based offset and the byte count.
+local function range(self, i, j)
+  local offset = i and i - 1 or 0
+  j = j or self.length
+  if offset < 0 or offset > self.length or j > self.length then
+    error("Range out of bounds")
+  end
+  return offset, math.max(j - offset, 0)
 end
 
-function Buffer:writeUInt8(offset, value)
-  self[offset] = value
+-- A view of bytes i to j that shares this buffer's memory.  The view keeps
+-- the buffer alive, so the memory is only freed once no views are left.
+function Buffer:slice(i, j)
+  local offset, length = range(self, i, j)
+  local view = setmetatable({}, getmetatable(self))
+  view.length = length
+  view.ctype = self.ctype + offset
+  view.parent = self
+  view.readOnly = self.readOnly
+  return view
 end
 
-function Buffer:writeInt8(offset, value)
-  return self:writeUInt8(offset, value)
+Buffer.subarray = Buffer.slice
+
+-- Copy bytes i to j of this buffer into target at targetStart.  Copies no
+-- more than fits in target and returns the number of bytes copied.
+function Buffer:copy(target, targetStart, i, j)
+  targetStart = targetStart or 1
+  if targetStart < 1 or targetStart > target.length + 1 then
+    error("Range out of bounds")
+  end
+  checkWritable(target)
+  local offset, length = range(self, i, j)
+  length = math.min(length, target.length - targetStart + 1)
+  -- memmove since slices of the same buffer may overlap
+  C.memmove(target.ctype + targetStart - 1, self.ctype + offset, length)
+  return length
 end
 
-function Buffer:writeUInt16LE(offset, value)
-  self[offset] = bit.rshift(value, 0)
-  self[offset + 1] = bit.rshift(value, 8)
+-- Set bytes i to j to value, a byte or a string repeated to fill the range.
+function Buffer:fill(value, i, j)
+  local offset, length = range(self, i, j)
+  checkWritable(self)
+  local ptr = self.ctype + offset
+  if type(value) == "number" then
+    ffi.fill(ptr, length, value)
+  elseif #value <= 1 or length == 0 then
+    ffi.fill(ptr, length, value:byte() or 0)
+  else
+    -- Lay down one copy, then keep doubling it
+    local filled = math.min(#value, length)
+    ffi.copy(ptr, value, filled)
+    while filled < length do
+      local n = math.min(filled, length - filled)
+      ffi.copy(ptr + filled, ptr, n)
+      filled = filled + n
+    end
+  end
+  return self
+end
+
+local function byteLength(item)
+  return type(item) == "string" and #item or item.length
 end
 
-function Buffer:writeUInt16BE(offset, value)
-  self[offset] = bit.rshift(value, 8)
-  self[offset + 1] = bit.rshift(value, 0)
+-- Join a list of buffers and strings into a new buffer.
+function Buffer.concat(list, totalLength)
+  if not totalLength then
+    totalLength = 0
+    for k = 1, #list do
+      totalLength = totalLength + byteLength(list[k])
+    end
+  end
+  local result = Buffer:new(totalLength)
+  local position = 0
+  for k = 1, #list do
+    local item = list[k]
+    local length = math.min(byteLength(item), totalLength - position)
+    if length <= 0 then break end
+    ffi.copy(result.ctype + position, type(item) == "string" and item or item.ctype, length)
+    position = position + length
+  end
+  return result
 end
 
-Buffer.writeInt16LE = Buffer.writeUInt16LE
-Buffer.writeInt16BE = Buffer.writeUInt16BE
+-- Small buffers from allocUnsafe are carved out of shared 8K slabs, so
+-- they cost neither a malloc nor a finalizer of their own.  A slab is freed
+-- once every buffer cut from it has been collected.
+local POOL_SIZE = 8 * 1024
+local poolSlab
+local poolOffset = 0
+local poolHits, poolMisses, poolSlabs = 0, 0, 0
 
-function Buffer:writeUInt32LE(offset, value)
-  self[offset] = bit.rshift(value, 0)
-  self[offset + 1] = bit.rshift(value, 8)
-  self[offset + 2] = bit.rshift(value, 16)
-  self[offset + 3] = bit.rshift(value, 24)
+local function allocate(length)
+  return ffi.gc(ffi.cast("unsigned char*", C.malloc(length)), C.free)
 end
 
-function Buffer:writeUInt32BE(offset, value)
-  self[offset] = bit.rshift(value, 24)
-  self[offset + 1] = bit.rshift(value, 16)
-  self[offset + 2] = bit.rshift(value, 8)
-  self[offset + 3] = bit.rshift(value, 0)
+local function wrap(ptr, length, slab)
+  local buf = Buffer:create()
+  buf.length = length
+  buf.ctype = ptr
+  buf._slab = slab
+  return buf
 end
 
-Buffer.writeInt32LE = Buffer.writeUInt32LE
-Buffer.writeInt32BE = Buffer.writeUInt32BE
+-- A buffer of length bytes with undefined contents
+function buffer.allocUnsafe(length)
+  if type(length) ~= "number" or length < 0 then
+    error("Length must be a non-negative number")
+  end
+  if length > POOL_SIZE / 2 then
+    poolMisses = poolMisses + 1
+    return wrap(allocate(length), length)
+  end
+  if not poolSlab or poolOffset + length > POOL_SIZE then
+    poolSlab = allocate(POOL_SIZE)
+    poolOffset = 0
+    poolSlabs = poolSlabs + 1
+    poolMisses = poolMisses + 1
+  else
+    poolHits = poolHits + 1
+  end
+  local buf = wrap(poolSlab + poolOffset, length, poolSlab)
+  -- Keep the next buffer 8 byte aligned
+  poolOffset = bit.band(poolOffset + length + 7, -8)
+  return buf
+end
 
-function Buffer:toString(i, j)
-  local offset = i and i - 1 or 0
-  if (offset < 0 or offset > self.length) or (j and j > self.length) then error("Range out of bounds") end
-  return ffi.string(self.ctype + offset, (j or self.length) - offset)
+-- A pooled buffer with every byte set to fill (0 by default)
+function buffer.alloc(length, fill)
+  local buf = buffer.allocUnsafe(length)
+  ffi.fill(buf.ctype, length, fill or 0)
+  return buf
 end
 
-function Buffer.isBuffer(b)
-  return instanceof(b, Buffer)
+-- A free list of equally sized buffers to read into, see
+-- net.Socket:readInto.  get() hands out a free buffer or allocates one;
+-- release(chunk) takes back a buffer, or any slice of one, once its data
+-- has been used.  Releasing a buffer that is already free does nothing.
+-- At most `max` buffers are kept on the free list.
+local Pool = Object:extend()
+buffer.Pool = Pool
+
+function Pool:initialize(size, max)
+  self.size = size or 64 * 1024
+  self.max = max or 16
+  self.free = {}
+end
+
+function Pool:get()
+  local free = self.free
+  local n = #free
+  if n > 0 then
+    local buf = free[n]
+    free[n] = nil
+    buf._free = nil
+    return buf
+  end
+  return buffer.allocUnsafe(self.size)
+end
+
+function Pool:release(chunk)
+  -- Chunks from partial reads are slices of slices
+  local buf = chunk
+  while buf.parent do buf = buf.parent end
+  local free = self.free
+  if not buf._free and buf.length == self.size and #free < self.max then
+    buf._free = true
+    free[#free + 1] = buf
+  end
+end
+
+-- Allocation counts for allocUnsafe and alloc.  A hit is a buffer served
+-- from the current slab without calling malloc.
+function buffer.poolStats()
+  local total = poolHits + poolMisses
+  return {
+    hits = poolHits,
+    misses = poolMisses,
+    slabs = poolSlabs,
+    hitRate = total > 0 and poolHits / total or 0,
+  }
 end
 
 return buffer
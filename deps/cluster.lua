@@ -0,0 +1,188 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+--[[lit-meta
+  name = "luvit/cluster"
+  version = "2.0.0"
+  dependencies = {
+    "luvit/core@2.0.0",
+    "luvit/timer@2.1.0",
+  }
+  license = "Apache 2"
+  homepage = "https://github.com/luvit/luvit/blob/master/deps/cluster.lua"
+  description = "Run and supervise one luvit worker process per cpu core."
+  tags = {"luvit", "cluster", "process"}
+]]
+
+--[[
+The master process re-runs the current script as N worker processes and
+restarts them when they die.  Each worker listens on its own socket with
+`reusePort` so the kernel balances connections between them (on Linux and
+FreeBSD; macOS and the other BSDs share the port without balancing).
+
+  local cluster = require('cluster')
+  cluster.run({ workers = 4 }, function (id)
+    http.createServer(onRequest):listen({ port = 8080, reusePort = true })
+  end)
+]]
+
+local uv = require('uv')
+local env = require('env')
+local Emitter = require('core').Emitter
+local timer = require('timer')
+
+local WORKER_ENV = "LUVIT_CLUSTER_WORKER"
+
+-- Workers that die sooner than this after starting are restarted with backoff
+local MIN_UPTIME = 1000
+local MAX_RESTART_DELAY = 5000
+
+local cluster = Emitter:new()
+
+cluster.workerId = tonumber(env.get(WORKER_ENV))
+cluster.isWorker = cluster.workerId ~= nil
+cluster.isMaster = not cluster.isWorker
+
+-- Live workers by id
+cluster.workers = {}
+
+-- How workers are started, same executable and arguments as the master by
+-- default.  Change with cluster.setup before forking.
+cluster.settings = {
+  exec = uv.exepath(),
+  args = { unpack(args or {}) },
+  restart = true,
+}
+
+local shuttingDown = false
+local restartDelays = {}
+
+function cluster.setup(settings)
+  for key, value in pairs(settings) do
+    cluster.settings[key] = value
+  end
+end
+
+local Worker = Emitter:extend()
+cluster.Worker = Worker
+
+function Worker:initialize(id)
+  self.id = id
+end
+
+function Worker:kill(signal)
+  if self.handle and not uv.is_closing(self.handle) then
+    uv.process_kill(self.handle, signal or 'sigterm')
+  end
+end
+
+local fork
+
+local function onWorkerExit(worker, code, signal)
+  uv.close(worker.handle)
+  cluster.workers[worker.id] = nil
+  worker:emit('exit', code, signal)
+  cluster:emit('exit', worker, code, signal)
+
+  if shuttingDown or not cluster.settings.restart then return end
+
+  -- Back off when a worker keeps crashing right after it starts
+  local delay = 0
+  if uv.now() - worker.startTime < MIN_UPTIME then
+    delay = math.min((restartDelays[worker.id] or 50) * 2, MAX_RESTART_DELAY)
+  end
+  restartDelays[worker.id] = delay > 0 and delay or nil
+  timer.setTimeout(delay, function ()
+    if not shuttingDown then fork(worker.id) end
+  end)
+end
+
+-- Start the worker process with the given id (1 based)
+function fork(id)
+  assert(cluster.isMaster, "only the master can fork workers")
+  local settings = cluster.settings
+
+  local envPairs = {}
+  for _, key in ipairs(env.keys()) do
+    if key ~= WORKER_ENV then
+      envPairs[#envPairs + 1] = key .. '=' .. env.get(key)
+    end
+  end
+  envPairs[#envPairs + 1] = WORKER_ENV .. '=' .. id
+
+  local worker = Worker:new(id)
+  local handle, pid = uv.spawn(settings.exec, {
+    args = settings.args,
+    env = envPairs,
+    stdio = {0, 1, 2},
+  }, function (code, signal)
+    onWorkerExit(worker, code, signal)
+  end)
+  if not handle then
+    error("Failed to spawn worker " .. id .. ": " .. tostring(pid))
+  end
+
+  worker.handle = handle
+  worker.pid = pid
+  worker.startTime = uv.now()
+  cluster.workers[id] = worker
+  cluster:emit('fork', worker)
+  return worker
+end
+cluster.fork = fork
+
+-- Stop restarting workers and send them all a signal
+function cluster.shutdown(signal)
+  shuttingDown = true
+  for _, worker in pairs(cluster.workers) do
+    worker:kill(signal)
+  end
+end
+
+-- In the master, fork `options.workers` workers (one per cpu by default) and
+-- supervise them.  In a worker, call fn with the worker id.
+function cluster.run(options, fn)
+  if type(options) == 'function' then
+    fn = options
+    options = {}
+  end
+  options = options or {}
+  if cluster.isWorker then
+    return fn(cluster.workerId)
+  end
+
+  local count = options.workers or #uv.cpu_info()
+  for id = 1, count do
+    fork(id)
+  end
+
+  -- Take the workers down with the master
+  local function onSignal(signal)
+    return function ()
+      cluster.shutdown(signal)
+      process:removeListener('sigint', cluster._onSigint)
+      process:removeListener('sigterm', cluster._onSigterm)
+    end
+  end
+  cluster._onSigint = onSignal('sigint')
+  cluster._onSigterm = onSignal('sigterm')
+  process:on('sigint', cluster._onSigint)
+  process:on('sigterm', cluster._onSigterm)
+end
+
+return cluster
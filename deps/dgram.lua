@@ -17,10 +17,11 @@ limitations under the License.
 --]]
 --[[lit-meta
   name = "luvit/dgram"
-  version = "2.0.0"
+  version = "2.1.0"
   dependencies = {
     "luvit/core@2.0.0",
     "luvit/timer@2.0.0",
+    "luvit/utils@2.2.0",
   }
   license = "Apache 2"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/dgram.lua"
@@ -31,6 +32,7 @@ limitations under the License.
 local uv = require('uv')
 local Emitter = require('core').Emitter
 local timer = require('timer')
+local toWriteData = require('utils').toWriteData
 
 local function start_listening(self)
   uv.udp_recv_start(self._handle, function(err, msg, rinfo, flags)
@@ -75,7 +77,7 @@ end
 
 function Socket:send(data, port, host, callback)
   timer.active(self)
-  uv.udp_send(self._handle, data, host, port, callback)
+  uv.udp_send(self._handle, toWriteData(data), host, port, callback)
 end
 
 function Socket:bind(port, host, options)
@@ -17,11 +17,13 @@ limitations under the License.
 --]]
 --[[lit-meta
   name = "luvit/fs"
-  version = "2.0.3"
+  version = "2.5.0"
   dependencies = {
-    "luvit/utils@2.0.0",
+    "luvit/utils@2.2.0",
     "luvit/path@2.0.0",
     "luvit/stream@2.0.0",
+    "luvit/buffer@2.5.0",
+    "luvit/timer@2.3.0",
   }
   license = "Apache 2"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/fs.lua"
@@ -30,12 +32,17 @@ limitations under the License.
 ]]
 
 local uv = require('uv')
+local ffi = require('ffi')
 local adapt = require('utils').adapt
 local bind = require('utils').bind
+local toWriteData = require('utils').toWriteData
 local join = require('path').join
 local Error = require('core').Error
+local Object = require('core').Object
 local Writable = require('stream').Writable
 local Readable = require('stream').Readable
+local Buffer = require('buffer').Buffer
+local timer = require('timer')
 local fs = {}
 
 function fs.close(fd, callback)
@@ -123,13 +130,13 @@ function fs.write(fd, offset, data, callback)
   if offset == nil then
     offset = -1 -- -1 means append
   end
-  return adapt(callback, uv.fs_write, fd, data, offset)
+  return adapt(callback, uv.fs_write, fd, toWriteData(data), offset)
 end
 function fs.writeSync(fd, offset, data)
   if offset == nil then
     offset = -1 -- -1 means append
   end
-  return uv.fs_write(fd, data, offset)
+  return uv.fs_write(fd, toWriteData(data), offset)
 end
 function fs.mkdir(path, mode, callback)
   local mt = type(mode)
@@ -491,7 +498,7 @@ local function writeFile(path, data, callback)
   uv.fs_open(path, "w", 438 --[[ 0666 ]], function (err, result)
     if err then return callback(err) end
     fd = result
-    uv.fs_write(fd, data, 0, onWrite)
+    uv.fs_write(fd, toWriteData(data), 0, onWrite)
   end)
   function onWrite(err)
     uv.fs_close(fd, noop)
@@ -505,7 +512,7 @@ function fs.writeFileSync(path, data)
   local _, fd, err
   fd, err = uv.fs_open(path, "w", 438 --[[ 0666 ]])
   if err then return false, err end
-  _, err = uv.fs_write(fd, data, 0)
+  _, err = uv.fs_write(fd, toWriteData(data), 0)
   uv.fs_close(fd, noop)
   return not err, err
 end
@@ -527,10 +534,74 @@ function fs.WriteStream:initialize(path, options)
 
   self.pos = self.start
 
+  -- Hold writes back for up to coalesceDelay ms, or until coalesceSize bytes
+  -- are waiting, and write them all with one vectored write
+  self.coalesceDelay = self.options.coalesceDelay
+  self.coalesceSize = self.options.coalesceSize or 65536
+  -- fdatasync once syncBytes bytes were written since the last sync and at
+  -- most syncInterval ms after a write
+  self.syncBytes = self.options.syncBytes
+  self.syncInterval = self.options.syncInterval
+  self.unsynced = 0
+
   if not self.fd then self:open() end
 
   self:on('finish', bind(self.close, self))
 end
+local function flushCoalesced(self)
+  if not self._coalescing then return end
+  self._coalescing = false
+  timer.clearTimer(self._coalesceTimer)
+  self._coalesceTimer = nil
+  self:uncork()
+end
+function fs.WriteStream:write(chunk, callback)
+  if self.coalesceDelay and not self._coalescing then
+    self._coalescing = true
+    self:cork()
+    self._coalesceTimer = timer.setTimeout(self.coalesceDelay, flushCoalesced, self)
+  end
+  local ret = Writable.write(self, chunk, callback)
+  if self._coalescing and self._writableState.length >= self.coalesceSize then
+    flushCoalesced(self)
+  end
+  return ret
+end
+function fs.WriteStream:_end(...)
+  flushCoalesced(self)
+  return Writable._end(self, ...)
+end
+local function syncNow(self, callback)
+  if self._syncTimer then
+    timer.clearTimer(self._syncTimer)
+    self._syncTimer = nil
+  end
+  self.unsynced = 0
+  if not self.fd then return callback and callback() end
+  fs.fdatasync(self.fd, function(err)
+    -- The writer waiting on this sync learns the data isn't durable
+    if callback then return callback(err) end
+    if err then self:emit('error', err) end
+  end)
+end
+function fs.WriteStream:_afterWrite(err, bytes, callback)
+  if err then
+    self:destroy()
+    return callback(err)
+  end
+  self.bytesWritten = self.bytesWritten + bytes
+  if self.pos then self.pos = self.pos + bytes end
+  if self.syncBytes or self.syncInterval then
+    self.unsynced = self.unsynced + bytes
+    if self.syncBytes and self.unsynced >= self.syncBytes then
+      return syncNow(self, callback)
+    end
+    if self.syncInterval and not self._syncTimer then
+      self._syncTimer = timer.setTimeout(self.syncInterval, syncNow, self)
+    end
+  end
+  callback()
+end
 function fs.WriteStream:open(callback)
   if self.fd then self:destroy() end
   fs.open(self.path, self.flags, nil, function(err, fd)
@@ -549,19 +620,42 @@ function fs.WriteStream:_write(data, callback)
   if not self.fd then
     return self:once('open', bind(self._write, self, data, callback))
   end
-  fs.write(self.fd, nil, data, function(err, bytes)
-    if err then
-      self:destroy()
-      return callback(err)
-    end
-    self.bytesWritten = self.bytesWritten + bytes
-    callback()
+  fs.write(self.fd, self.pos, data, function(err, bytes)
+    self:_afterWrite(err, bytes, callback)
+  end)
+end
+-- Everything buffered while a write was in flight (or while corked) goes
+-- out as one pwritev
+function fs.WriteStream:_writev(requests, callback)
+  if not self.fd then
+    return self:once('open', bind(self._writev, self, requests, callback))
+  end
+  local chunks = {}
+  for i = 1, #requests do
+    chunks[i] = requests[i].chunk
+  end
+  fs.write(self.fd, self.pos, chunks, function(err, bytes)
+    self:_afterWrite(err, bytes, callback)
   end)
 end
 function fs.WriteStream:close()
+  if self.unsynced > 0 and self.fd then
+    return syncNow(self, function(err)
+      self:destroy()
+      if err then self:emit('error', err) end
+    end)
+  end
   self:destroy()
 end
 function fs.WriteStream:destroy()
+  if self._coalesceTimer then
+    timer.clearTimer(self._coalesceTimer)
+    self._coalesceTimer = nil
+  end
+  if self._syncTimer then
+    timer.clearTimer(self._syncTimer)
+    self._syncTimer = nil
+  end
   if self.fd then
     fs.close(self.fd)
     self.fd = nil
@@ -600,6 +694,85 @@ function fs.WriteStreamSync:_write(data, callback)
   self.bytesWritten = self.bytesWritten + written
   callback()
 end
+function fs.WriteStreamSync:_writev(requests, callback)
+  local chunks = {}
+  for i = 1, #requests do
+    chunks[i] = requests[i].chunk
+  end
+  return self:_write(chunks, callback)
+end
+
+local PROT_READ = 1
+local MAP_PRIVATE = 2
+local MADV_SEQUENTIAL = 2
+
+local mmapDefined = false
+local function defineMmap()
+  if mmapDefined then return end
+  mmapDefined = true
+  pcall(ffi.cdef, "void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);")
+  pcall(ffi.cdef, "int munmap(void *addr, size_t length);")
+  pcall(ffi.cdef, "int madvise(void *addr, size_t length, int advice);")
+end
+
+-- Map the first size bytes of the open file fd read-only and wrap the
+-- mapping in a Buffer.  The mapping is unmapped once the buffer and every
+-- slice of it is collected.
+local function mapFd(fd, size, sequential)
+  if ffi.os == "Windows" then
+    return nil, "ENOTSUP: mmap is not supported on Windows"
+  end
+  defineMmap()
+  local buf = Buffer:create()
+  buf.length = size
+  buf.readOnly = true
+  if size == 0 then
+    -- Nothing to map, mmap refuses empty mappings
+    buf.ctype = ffi.new("const unsigned char[1]")
+    return buf
+  end
+  local ptr = ffi.C.mmap(nil, size, PROT_READ, MAP_PRIVATE, fd, 0)
+  if ffi.cast("intptr_t", ptr) == -1 then
+    return nil, "EMMAP: mmap failed with errno " .. ffi.errno()
+  end
+  if sequential then
+    ffi.C.madvise(ptr, size, MADV_SEQUENTIAL)
+  end
+  buf.ctype = ffi.gc(ffi.cast("const unsigned char*", ptr), function (p)
+    ffi.C.munmap(ffi.cast("void*", p), size)
+  end)
+  return buf
+end
+
+-- A read-only Buffer backed by a memory mapping of the file at path, so
+-- even huge files can be scanned without copying them into the Lua heap.
+-- Writing to the buffer raises an error and the file must not shrink while
+-- it is mapped.  Not available on Windows.
+function fs.mmapSync(path)
+  local fd, err = uv.fs_open(path, "r", 438 --[[ 0666 ]])
+  if not fd then return nil, err end
+  local stat, buf
+  stat, err = uv.fs_fstat(fd)
+  if stat then
+    buf, err = mapFd(fd, stat.size)
+  end
+  uv.fs_close(fd)
+  return buf, err
+end
+function fs.mmap(path, callback)
+  fs.open(path, "r", function (err, fd)
+    if err then return callback(err) end
+    fs.fstat(fd, function (err, stat)
+      local buf
+      if stat then
+        buf, err = mapFd(fd, stat.size)
+      end
+      fs.close(fd, function ()
+        callback(err, buf)
+      end)
+    end)
+  end)
+end
 
 local CHUNK_SIZE = 65536
 
@@ -609,7 +782,10 @@ local read_options = {
   chunkSize = CHUNK_SIZE,
   fd = nil,
   reading = nil,
-  length = nil -- nil means read to EOF
+  length = nil, -- nil means read to EOF
+  mmap = nil, -- push slices of a memory mapping instead of reading
+  readAhead = 1, -- reads kept in flight at once
+  maxChunkSize = nil -- let chunks grow up to this while the disk lags
 }
 local read_meta = {__index=read_options}
 
@@ -627,6 +803,9 @@ function fs.ReadStream:initialize(path, options)
   self.offset = options.offset
   self.chunkSize = options.chunkSize
   self.length = options.length
+  self.mmap = options.mmap
+  self.readAhead = options.readAhead
+  self.maxChunkSize = options.maxChunkSize
   self.bytesRead = 0
   if not self.fd then self:open() end
   self:on('end', bind(self.close, self))
@@ -650,6 +829,11 @@ function fs.ReadStream:_read(n)
     return self:once('open', bind(self._read, self, n))
   end
 
+  if self.mmap then return self:_readMapped(n) end
+  if self.readAhead and self.readAhead > 1 then
+    return self:_readAhead(n)
+  end
+
   local to_read = self.chunkSize or n
   if self.length then
     -- indicating length was set in option; need to check boundary
@@ -671,6 +855,132 @@ function fs.ReadStream:_read(n)
     end
   end)
 end
+-- With readAhead > 1 up to that many reads are in flight at consecutive
+-- offsets and their results are pushed in order, so the threadpool keeps
+-- the disk busy while the consumer handles a chunk.  The end of the file is
+-- taken from fstat when reading starts.  With maxChunkSize set, the chunk
+-- size doubles each time the consumer had to wait for a read and halves
+-- back towards chunkSize while finished reads pile up.
+function fs.ReadStream:_readAhead(n)
+  local ahead = self._ahead
+  if not ahead then
+    -- Stat on the threadpool too, a slow disk mustn't stall the loop here
+    if self._statingAhead then return end
+    self._statingAhead = true
+    local fd = self.fd
+    return fs.fstat(fd, function (err, stat)
+      self._statingAhead = nil
+      if self.fd ~= fd then return end
+      if err then return self:destroy(err) end
+      local offset = self.offset or 0
+      local stop = stat.size
+      if self.length then stop = math.min(stop, offset + self.length) end
+      local chunkSize = self.chunkSize or n
+      self._ahead = {
+        offset = offset, -- where the next read starts
+        stop = stop,
+        chunkSize = chunkSize,
+        minChunkSize = chunkSize,
+        maxChunkSize = math.max(self.maxChunkSize or chunkSize, chunkSize),
+        issued = 0,
+        delivered = 0,
+        inflight = 0,
+        ready = 0,
+        results = {},
+      }
+      self:_readAhead(n)
+    end)
+  end
+  ahead.wanted = true
+  self:_deliverAhead()
+  self:_fillAhead()
+end
+function fs.ReadStream:_fillAhead()
+  local ahead = self._ahead
+  while not ahead.done and ahead.inflight + ahead.ready < self.readAhead and
+      ahead.offset < ahead.stop do
+    local size = math.min(ahead.chunkSize, ahead.stop - ahead.offset)
+    local seq = ahead.issued + 1
+    ahead.issued = seq
+    ahead.inflight = ahead.inflight + 1
+    fs.read(self.fd, size, ahead.offset, function (err, data)
+      if self._ahead ~= ahead or not self.fd then return end
+      ahead.inflight = ahead.inflight - 1
+      ahead.ready = ahead.ready + 1
+      ahead.results[seq] = { err = err, data = data }
+      if ahead.wanted and seq == ahead.delivered + 1 then
+        -- The consumer was waiting on the disk, read more at once
+        ahead.chunkSize = math.min(ahead.chunkSize * 2, ahead.maxChunkSize)
+      elseif ahead.ready > 1 then
+        ahead.chunkSize = math.max(math.floor(ahead.chunkSize / 2), ahead.minChunkSize)
+      end
+      self:_deliverAhead()
+      self:_fillAhead()
+    end)
+    ahead.offset = ahead.offset + size
+  end
+end
+function fs.ReadStream:_deliverAhead()
+  local ahead = self._ahead
+  while ahead.wanted and not ahead.done do
+    local seq = ahead.delivered + 1
+    local result = ahead.results[seq]
+    if not result then break end
+    ahead.results[seq] = nil
+    ahead.delivered = seq
+    ahead.ready = ahead.ready - 1
+    if result.err then
+      ahead.done = true
+      return self:destroy(result.err)
+    end
+    local data = result.data
+    if #data == 0 then
+      -- The file shrank since it was stat'ed
+      ahead.done = true
+      return self:push()
+    end
+    self.bytesRead = self.bytesRead + #data
+    ahead.wanted = self:push(data)
+  end
+  if not ahead.done and ahead.delivered == ahead.issued and
+      ahead.offset >= ahead.stop then
+    ahead.done = true
+    self:push()
+  end
+end
+-- In mmap mode every chunk is a Buffer slice of one mapping of the file,
+-- nothing is copied until the consumer reads the bytes.
+function fs.ReadStream:_readMapped(n)
+  if not self.map then
+    if self._statingMap then return end
+    self._statingMap = true
+    local fd = self.fd
+    return fs.fstat(fd, function (err, stat)
+      self._statingMap = nil
+      if self.fd ~= fd then return end
+      local map
+      if stat then
+        map, err = mapFd(fd, stat.size, true)
+      end
+      if not map then return self:destroy(err) end
+      self.map = map
+      self.mapOffset = self.offset or 0
+      self.mapEnd = map.length
+      if self.length then
+        self.mapEnd = math.min(self.mapEnd, self.mapOffset + self.length)
+      end
+      self:_readMapped(n)
+    end)
+  end
+  local start = self.mapOffset
+  if start >= self.mapEnd then
+    return self:push()
+  end
+  local stop = math.min(start + (self.chunkSize or n), self.mapEnd)
+  self.mapOffset = stop
+  self.bytesRead = self.bytesRead + stop - start
+  self:push(self.map:slice(start + 1, stop))
+end
 function fs.ReadStream:close()
   self:destroy()
 end
@@ -713,4 +1023,188 @@ function fs.appendFileSync(path, data)
   fs.close(fd)
 end
 
+-- Keeps hot files open with their stat, etag and, for small files, their
+-- contents, so serving the same file again costs no syscalls.  A uv
+-- fs_event watcher drops an entry as soon as its file changes and the least
+-- recently used entries are closed once there are more than max of them.
+--
+--   local cache = fs.FileCache:new({ max = 128, maxContentSize = 16384 })
+--   cache:open(path, function (err, file)
+--     -- file.fd (nil when file.content is set), file.stat, file.etag
+--     cache:release(file)
+--   end)
+--
+-- Hits call back right away.  Every successful open must be released.
+fs.FileCache = Object:extend()
+function fs.FileCache:initialize(options)
+  options = options or {}
+  self.max = options.max or 128
+  self.maxContentSize = options.maxContentSize or 16384
+  self.watch = options.watch ~= false
+  self.entries = {}
+  self.count = 0
+  self.clock = 0
+  self.loading = {}
+  self.hits = 0
+  self.misses = 0
+end
+function fs.FileCache:open(path, callback)
+  local entry = self.entries[path]
+  if entry then
+    self.hits = self.hits + 1
+    self.clock = self.clock + 1
+    entry.used = self.clock
+    entry.refs = entry.refs + 1
+    return callback(nil, entry)
+  end
+  self.misses = self.misses + 1
+  -- Concurrent misses for the same path share one load
+  local waiting = self.loading[path]
+  if waiting then
+    waiting[#waiting + 1] = callback
+    return
+  end
+  waiting = { callback }
+  self.loading[path] = waiting
+  self:_load(path, function (err, entry)
+    self.loading[path] = nil
+    if entry then
+      entry.refs = #waiting
+      self:_add(entry)
+    end
+    for i = 1, #waiting do
+      waiting[i](err, entry)
+    end
+  end)
+end
+function fs.FileCache:_load(path, callback)
+  fs.open(path, "r", function (err, fd)
+    if err then return callback(err) end
+    fs.fstat(fd, function (err, stat)
+      if not err and stat.type ~= "file" then
+        err = "EISDIR: not a regular file: " .. path
+      end
+      if err then
+        return fs.close(fd, function () callback(err) end)
+      end
+      local entry = {
+        path = path,
+        fd = fd,
+        stat = stat,
+        etag = string.format('"%x-%x"', stat.mtime.sec, stat.size),
+      }
+      if stat.size > self.maxContentSize then
+        return callback(nil, entry)
+      end
+      -- Small files are kept in memory and need no fd
+      fs.read(fd, stat.size, 0, function (err, content)
+        entry.fd = nil
+        fs.close(fd, function ()
+          if err then return callback(err) end
+          entry.content = content
+          callback(nil, entry)
+        end)
+      end)
+    end)
+  end)
+end
+function fs.FileCache:_add(entry)
+  local path = entry.path
+  self.clock = self.clock + 1
+  entry.used = self.clock
+  if self.watch then
+    local watcher = uv.new_fs_event()
+    if not uv.fs_event_start(watcher, path, {}, function ()
+      self:invalidate(path)
+    end) then
+      -- Can't tell when it changes, so don't keep it
+      uv.close(watcher)
+      entry.stale = true
+      return
+    end
+    uv.unref(watcher)
+    entry.watcher = watcher
+  end
+  if self.count >= self.max and not self:_evict() then
+    entry.stale = true
+    return self:_unwatch(entry)
+  end
+  self.entries[path] = entry
+  self.count = self.count + 1
+end
+-- Drop the least recently used entry that is not in use
+function fs.FileCache:_evict()
+  local oldest
+  for _, entry in pairs(self.entries) do
+    if entry.refs == 0 and (not oldest or entry.used < oldest.used) then
+      oldest = entry
+    end
+  end
+  if not oldest then return false end
+  self:invalidate(oldest.path)
+  return true
+end
+function fs.FileCache:_unwatch(entry)
+  if entry.watcher then
+    uv.close(entry.watcher)
+    entry.watcher = nil
+  end
+end
+function fs.FileCache:_close(entry)
+  if entry.fd then
+    fs.close(entry.fd)
+    entry.fd = nil
+  end
+end
+-- Forget the file at path, its fd is closed once the last user releases it.
+function fs.FileCache:invalidate(path)
+  local entry = self.entries[path]
+  if not entry then return end
+  self.entries[path] = nil
+  self.count = self.count - 1
+  entry.stale = true
+  self:_unwatch(entry)
+  if entry.refs == 0 then self:_close(entry) end
+end
+function fs.FileCache:release(entry)
+  entry.refs = entry.refs - 1
+  if entry.refs == 0 and entry.stale then
+    self:_close(entry)
+  end
+end
+function fs.FileCache:stat(path, callback)
+  self:open(path, function (err, entry)
+    if err then return callback(err) end
+    self:release(entry)
+    callback(nil, entry.stat, entry.etag)
+  end)
+end
+function fs.FileCache:readFile(path, callback)
+  self:open(path, function (err, entry)
+    if err then return callback(err) end
+    if entry.content then
+      self:release(entry)
+      return callback(nil, entry.content)
+    end
+    fs.read(entry.fd, entry.stat.size, 0, function (err, data)
+      self:release(entry)
+      callback(err, data)
+    end)
+  end)
+end
+function fs.FileCache:close()
+  for path in pairs(self.entries) do
+    self:invalidate(path)
+  end
+end
+function fs.FileCache:stats()
+  local total = self.hits + self.misses
+  return {
+    hits = self.hits,
+    misses = self.misses,
+    entries = self.count,
+    hitRate = total > 0 and self.hits / total or 0,
+  }
+end
+
 return fs
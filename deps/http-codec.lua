@@ -18,7 +18,7 @@ limitations under the License.
 
 --[[lit-meta
   name = "luvit/http-codec"
-  version = "2.0.5"
+  version = "2.2.0"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/http-codec.lua"
   description = "A simple pair of functions for converting between hex and raw strings."
   tags = {"codec", "http"}
@@ -33,6 +33,12 @@ local find = string.find
 local format = string.format
 local concat = table.concat
 local match = string.match
+local max = math.max
+
+-- Use the native incremental head parser when it has been built and installed
+-- (see native/httpparser), otherwise heads are parsed with lua patterns.
+local hasNative, httpparser = pcall(require, 'httpparser')
+if not hasNative then httpparser = nil end
 
 local STATUS_CODES = {
   [100] = 'Continue',
@@ -93,6 +99,46 @@ local STATUS_CODES = {
   [511] = 'Network Authentication Required'     -- RFC 6585
 }
 
+-- Encoded "key: value\r\n" lines for header pairs that are sent over and over
+-- (Server, Content-Type, Connection, ...), indexed by key and then value.  A
+-- key's values are dropped and cached afresh once it has seen too many, so
+-- keys with ever changing values (Date, Content-Length) stay bounded while
+-- the common values of the others come back into the cache.
+local MAX_CACHED_KEYS = 64
+local MAX_CACHED_VALUES = 16
+local headerCache = {}
+local cachedKeys = 0
+
+local function cacheEntry(key)
+  local entry = headerCache[key]
+  if entry == nil and cachedKeys < MAX_CACHED_KEYS and type(key) == "string" then
+    cachedKeys = cachedKeys + 1
+    entry = { lower = lower(key), values = {}, count = 0 }
+    headerCache[key] = entry
+  end
+  return entry
+end
+
+-- Status lines for the known status codes, indexed by version and then code.
+local statusLines = {}
+
+local function statusLine(version, code, reason)
+  if reason or not STATUS_CODES[code] then
+    return 'HTTP/' .. version .. ' ' .. code .. ' ' .. (reason or STATUS_CODES[code] or "Unknown reason") .. '\r\n'
+  end
+  local lines = statusLines[version]
+  if not lines then
+    lines = {}
+    statusLines[version] = lines
+  end
+  local line = lines[code]
+  if not line then
+    line = 'HTTP/' .. version .. ' ' .. code .. ' ' .. STATUS_CODES[code] .. '\r\n'
+    lines[code] = line
+  end
+  return line
+end
+
 local function encoder()
 
   local mode
@@ -109,21 +155,52 @@ local function encoder()
     if item.method then
       local path = item.path
       assert(path and #path > 0, "expected non-empty path")
-      head = { item.method .. ' ' .. item.path .. ' HTTP/' .. version .. '\r\n' }
+      head = { item.method, ' ', path, ' HTTP/', version, '\r\n' }
     else
-      local reason = item.reason or STATUS_CODES[item.code] or "Unknown reason"
-      head = { 'HTTP/' .. version .. ' ' .. item.code .. ' ' .. reason .. '\r\n' }
+      head = { statusLine(version, item.code, item.reason) }
     end
+    -- Everything is appended to head and joined with a single concat
+    local n = #head
     for i = 1, #item do
       local key, value = item[i][1], item[i][2]
-      local lowerKey = lower(key)
+      local entry = cacheEntry(key)
+      local line = entry and entry.values[value]
+      local lowerKey = entry and entry.lower or lower(key)
       if lowerKey == "transfer-encoding" then
-        chunkedEncoding = lower(value) == "chunked"
+        chunkedEncoding = lower(tostring(value)) == "chunked"
+      end
+      if line then
+        -- Cached lines were already sanitized when they were first encoded
+        n = n + 1
+        head[n] = line
+      else
+        local raw = value
+        value = tostring(value)
+        if find(value, "[\r\n]") then
+          value = gsub(value, "[\r\n]+", " ")
+        end
+        if entry and raw ~= nil then
+          if entry.count >= MAX_CACHED_VALUES then
+            -- Too many different values, start over with this one
+            entry.values = {}
+            entry.count = 0
+          end
+          entry.count = entry.count + 1
+          line = key .. ': ' .. value .. '\r\n'
+          entry.values[raw] = line
+          n = n + 1
+          head[n] = line
+        end
+        if not line then
+          head[n + 1] = key
+          head[n + 2] = ': '
+          head[n + 3] = value
+          head[n + 4] = '\r\n'
+          n = n + 4
+        end
       end
-      value = gsub(tostring(value), "[\r\n]+", " ")
-      head[#head + 1] = key .. ': ' .. tostring(value) .. '\r\n'
     end
-    head[#head + 1] = '\r\n'
+    head[n + 1] = '\r\n'
 
     mode = chunkedEncoding and encodeChunked or encodeRaw
     return concat(head)
@@ -159,36 +236,56 @@ local function encoder()
   end
 end
 
-local function decoder()
+-- decoder([options]) parses heads with the native parser when it's
+-- installed.  Set options.native to false to always use the lua parser, or
+-- to true to require the native one.
+local function decoder(options)
+  local native = options and options.native
+  if native and not httpparser then
+    error("native httpparser is not installed")
+  end
 
   -- This decoder is somewhat stateful with 5 different parsing states.
+  -- Each state decodes `chunk` starting at `index` and returns the event and
+  -- the index of the first byte it didn't consume.  When it needs more data it
+  -- returns nil and, if it knows, how many bytes from `index` it is waiting for.
   local decodeHead, decodeEmpty, decodeRaw, decodeChunked, decodeCounted
   local mode -- state variable that points to various decoders
   local bytesLeft -- For counted decoder
 
-  -- This state is for decoding the status line and headers.
-  function decodeHead(chunk)
-    if not chunk then return end
-
-    local _, length = find(chunk, "\r?\n\r?\n", 1)
+  -- Parses the status line and headers with lua patterns.
+  -- Returns head, length, contentLength, chunkedEncoding once the full head
+  -- is available.  `scanned` remembers how far the search for the end of the
+  -- head got so partial heads are not scanned from the start again, it's
+  -- only kept when resume says this call continues the previous one.
+  local scanned = 0
+  local function parseHead(chunk, index, resume)
+    local available = #chunk - index + 1
+    if not resume then scanned = 0 end
+    local _, length = find(chunk, "\r?\n\r?\n", index + scanned)
     -- First make sure we have all the head before continuing
     if not length then
-      if #chunk < 8 * 1024 then return end
+      if available < 8 * 1024 then
+        -- Back up enough to catch a terminator split across reads.
+        scanned = max(0, available - 3)
+        return
+      end
       -- But protect against evil clients by refusing heads over 8K long.
       error("entity too large")
     end
+    scanned = 0
 
     -- Parse the status/request line
     local head = {}
     local _, offset
     local version
     _, offset, version, head.code, head.reason =
-      find(chunk, "^HTTP/(%d%.%d) (%d+) ([^\r\n]*)\r?\n")
+      find(chunk, "^HTTP/(%d%.%d) (%d+) ([^\r\n]*)\r?\n", index)
     if offset then
       head.code = tonumber(head.code)
     else
       _, offset, head.method, head.path, version =
-        find(chunk, "^(%u+) ([^ ]+) HTTP/(%d%.%d)\r?\n")
+        find(chunk, "^(%u+) ([^ ]+) HTTP/(%d%.%d)\r?\n", index)
       if not offset then
         error("expected HTTP data")
       end
@@ -219,6 +316,28 @@ local function decoder()
       head[#head + 1] = {key, value}
     end
 
+    return head, length - index + 1, contentLength, chunkedEncoding
+  end
+
+  -- The native parser keeps its own scan state between calls.
+  local parser = native ~= false and httpparser and httpparser.new()
+  -- Set while a head is incomplete: the next call passes the same data with
+  -- more appended and parsing picks up where it stopped.
+  local headPending = false
+
+  -- This state is for decoding the status line and headers.
+  function decodeHead(chunk, index)
+    if not chunk then return end
+
+    local head, length, contentLength, chunkedEncoding
+    if parser then
+      head, length, contentLength, chunkedEncoding = parser:parse(chunk, index, headPending)
+    else
+      head, length, contentLength, chunkedEncoding = parseHead(chunk, index, headPending)
+    end
+    headPending = not head
+    if not head then return end
+
     if head.keepAlive and (not (chunkedEncoding or (contentLength and contentLength > 0)))
        or (head.method == "GET" or head.method == "HEAD") then
       mode = decodeEmpty
@@ -231,50 +350,52 @@ local function decoder()
       mode = decodeRaw
     end
 
-    return head, sub(chunk, length + 1)
+    return head, index + length
 
   end
 
   -- This is used for inserting a single empty string into the output string for known empty bodies
-  function decodeEmpty(chunk)
+  function decodeEmpty(_, index)
     mode = decodeHead
-    return "", chunk or ""
+    return "", index
   end
 
-  function decodeRaw(chunk)
-    if not chunk then return "", "" end
-    if #chunk == 0 then return end
-    return chunk, ""
+  function decodeRaw(chunk, index)
+    if not chunk then return "", index end
+    if index > #chunk then return end
+    if index > 1 then chunk = sub(chunk, index) end
+    return chunk, index + #chunk
   end
 
-  function decodeChunked(chunk)
+  function decodeChunked(chunk, index)
     local len, term
-    len, term = match(chunk, "^(%x+)(..)")
+    len, term = match(chunk, "^(%x+)(..)", index)
     if not len then return end
     if term ~= "\r\n" then
       -- Wait for full chunk-size\r\n header
-      if #chunk < 18 then return end
+      if #chunk - index + 1 < 18 then return end
       -- But protect against evil clients by refusing chunk-sizes longer than 16 hex digits.
       error("chunk-size field too large")
     end
     local length = tonumber(len, 16)
-    if #chunk < length + 4 + #len then return end
+    local total = length + 4 + #len
+    if #chunk - index + 1 < total then return nil, total end
     if length == 0 then
       mode = decodeHead
     end
-    chunk = sub(chunk, #len + 3)
-    assert(sub(chunk, length + 1, length + 2) == "\r\n")
-    return sub(chunk, 1, length), sub(chunk, length + 3)
+    local start = index + #len + 2
+    assert(sub(chunk, start + length, start + length + 1) == "\r\n")
+    return sub(chunk, start, start + length - 1), index + total
   end
 
-  function decodeCounted(chunk)
+  function decodeCounted(chunk, index)
     if bytesLeft == 0 then
       mode = decodeEmpty
-      return mode(chunk)
+      return mode(chunk, index)
     end
-    local length = #chunk
+    local length = #chunk - index + 1
     -- Make sure we have at least one byte to process
-    if length == 0 then return end
+    if length <= 0 then return end
 
     if length >= bytesLeft then
       mode = decodeEmpty
@@ -283,16 +404,27 @@ local function decoder()
     -- If the entire chunk fits, pass it all through
     if length <= bytesLeft then
       bytesLeft = bytesLeft - length
-      return chunk, ""
+      if index > 1 then chunk = sub(chunk, index) end
+      return chunk, index + length
     end
 
-    return sub(chunk, 1, bytesLeft), sub(chunk, bytesLeft + 1)
+    return sub(chunk, index, index + bytesLeft - 1), index + bytesLeft
   end
 
   -- Switch between states by changing which decoder mode points to
   mode = decodeHead
-  return function (chunk)
-    return mode(chunk)
+
+  -- decode(chunk) -> event, extra
+  -- decode(chunk, index) -> event, nextIndex
+  -- The second form never copies the unconsumed data.  In both forms the next
+  -- call after a nil event must pass the unconsumed data with more appended.
+  return function (chunk, index)
+    if index then
+      return mode(chunk, index)
+    end
+    local event, nextIndex = mode(chunk, 1)
+    if event == nil then return end
+    return event, sub(chunk or "", nextIndex)
   end
 
 end
@@ -300,4 +432,5 @@ end
 return {
   encoder = encoder,
   decoder = decoder,
+  hasNative = httpparser ~= nil,
 }
@@ -18,9 +18,11 @@ limitations under the License.
 
 --[[lit-meta
   name = "luvit/http"
-  version = "2.1.5"
+  version = "2.5.0"
   dependencies = {
-    "luvit/net@2.0.0",
+    "luvit/net@2.6.0",
+    "luvit/fs@2.2.0",
+    "luvit/timer@2.3.0",
     "luvit/url@2.0.0",
     "luvit/http-codec@2.0.0",
     "luvit/stream@2.0.0",
@@ -33,15 +35,23 @@ limitations under the License.
   tags = {"luvit", "http", "stream"}
 ]]
 
+local uv = require('uv')
 local net = require('net')
+local fs = require('fs')
+local ffi = require('ffi')
+local timer = require('timer')
 local url = require('url')
 local codec = require('http-codec')
 local Writable = require('stream').Writable
-local date = require('os').date
 local luvi = require('luvi')
 local utils = require('utils')
 local httpHeader = require('http-header')
 
+local sub = string.sub
+local find = string.find
+local format = string.format
+local concat = table.concat
+
 local IncomingMessage = net.Socket:extend()
 
 function IncomingMessage:initialize(head, socket)
@@ -89,6 +99,28 @@ end
 -- Override this in the instance to not send the date
 ServerResponse.sendDate = true
 
+-- Cork the socket on the first write of a turn and uncork it once the loop
+-- is done with the current I/O callbacks, so a response, and every
+-- pipelined response written in the same turn, goes out as one write.
+-- Override this in the instance (or set it here) to write straight through.
+ServerResponse.autoCork = true
+
+local function uncorkSocket(socket)
+  socket._httpCorked = nil
+  if not socket.destroyed then
+    socket:uncork()
+  end
+end
+
+function ServerResponse:_cork()
+  local socket = self.socket
+  if self.autoCork and not socket._httpCorked then
+    socket._httpCorked = true
+    socket:cork()
+    timer.setImmediate(uncorkSocket, socket)
+  end
+end
+
 function ServerResponse:setHeader(name, value)
   assert(not self.headersSent, "headers already sent")
   self.headers[name] = value
@@ -130,7 +162,7 @@ function ServerResponse:flushHeaders()
   end
 
   if not sent_date and self.sendDate then
-    head[#head + 1] = {"Date", date("!%a, %d %b %Y %H:%M:%S GMT")}
+    head[#head + 1] = {"Date", timer.httpDate()}
   end
   if self.hasBody and not sent_transfer_encoding and not sent_content_length then
     sent_transfer_encoding = true
@@ -159,6 +191,7 @@ function ServerResponse:flushHeaders()
   end
   head.code = statusCode
   local h = self.encode(head)
+  self:_cork()
   self.socket:write(h)
 end
 
@@ -167,6 +200,7 @@ function ServerResponse:write(chunk, callback)
     self.hasBody = true
   end
   self:flushHeaders()
+  self:_cork()
   return self.socket:write(self.encode(chunk), callback)
 end
 
@@ -191,6 +225,7 @@ function ServerResponse:finish(chunk)
     end
   end
   if #last > 0 then
+    self:_cork()
     self.socket:write(last, function()
       maybeClose()
     end)
@@ -205,12 +240,262 @@ function ServerResponse:writeHead(newStatusCode, newHeaders)
   self.headers = httpHeader.toHeaders(newHeaders)
 end
 
+-- Parse a single "bytes=first-last" range against a file of size bytes.
+-- Returns the first and last offsets (0 based, inclusive), false when the
+-- range can't be satisfied or nil to ignore it and send the whole file.
+local function parseRange(header, size)
+  local first, last = header:match("^%s*bytes%s*=%s*(%d*)%s*%-%s*(%d*)%s*$")
+  if not first or (first == "" and last == "") then return end
+  if first == "" then
+    -- Suffix range, the last n bytes
+    local n = tonumber(last)
+    if n == 0 or size == 0 then return false end
+    return math.max(size - n, 0), size - 1
+  end
+  first = tonumber(first)
+  if last == "" then
+    last = size - 1
+  else
+    last = tonumber(last)
+    if last < first then return end
+    last = math.min(last, size - 1)
+  end
+  if first >= size then return false end
+  return first, last
+end
+
+-- Write length bytes of fd starting at offset to the socket with
+-- sendfile(2), waiting for the socket to drain whenever the kernel buffer
+-- is full.  callback(err) once done.
+local function sendFileBody(socket, fd, offset, length, callback)
+  local outFd = uv.fileno(socket._handle)
+  local function send()
+    if socket.destroyed then
+      return callback("ECONNRESET: socket closed while sending file")
+    end
+    fs.sendfile(outFd, fd, offset, length, function (err, sent)
+      if err and not find(err, "^EAGAIN") then return callback(err) end
+      sent = sent or 0
+      if not err and sent == 0 then
+        return callback("EOF: file ended before Content-Length bytes were sent")
+      end
+      timer.active(socket)
+      offset, length = offset + sent, length - sent
+      if length == 0 then return callback() end
+      socket:_waitWritable(function (err)
+        if err then return callback(err) end
+        send()
+      end)
+    end)
+  end
+  -- Everything written so far, the head included, has to be out first
+  socket:write("", function (err)
+    if err then return callback(err) end
+    send()
+  end)
+end
+
+-- Where the bytes have to pass through Lua anyway (tls, Windows), read
+-- them in chunks and write each one once the previous one is out.
+local function streamFileBody(res, fd, offset, length, callback)
+  local function readMore()
+    fs.read(fd, math.min(length, 65536), offset, function (err, chunk)
+      if err then return callback(err) end
+      if #chunk == 0 then
+        return callback("EOF: file ended before Content-Length bytes were sent")
+      end
+      offset, length = offset + #chunk, length - #chunk
+      res:write(chunk, function (err)
+        if err then return callback(err) end
+        if length == 0 then return callback() end
+        readMore()
+      end)
+    end)
+  end
+  readMore()
+end
+
+-- Send the file at path as the response body.  Content-Length comes from
+-- fstat and on plain tcp sockets the body goes from the file straight to
+-- the socket with sendfile(2), without passing through Lua.  Options:
+--
+--   range: honor the request's Range header with a 206 (default true)
+--   etag: send an ETag built from mtime and size (or this string if it is
+--         one) and answer a matching If-None-Match with a 304 (default true)
+--   cacheControl: value for the Cache-Control header
+--   cache: an fs.FileCache to take the fd, stat and small file contents
+--          from instead of opening the file every time
+--
+-- callback(err) runs once the response is finished.  If the file can't be
+-- opened nothing has been sent yet and the caller can still respond.
+function ServerResponse:sendFile(path, options, callback)
+  if type(options) == 'function' then
+    callback, options = options, nil
+  end
+  options = options or {}
+  callback = callback or function () end
+  local cache = options.cache
+  if cache then
+    return cache:open(path, function (err, file)
+      if err then return callback(err) end
+      self:_sendFile(file, options, function (err)
+        cache:release(file)
+        callback(err)
+      end)
+    end)
+  end
+  fs.open(path, "r", function (err, fd)
+    if err then return callback(err) end
+    fs.fstat(fd, function (err, stat)
+      if not err and stat.type ~= "file" then
+        err = "EISDIR: not a regular file: " .. path
+      end
+      if err then
+        return fs.close(fd, function () callback(err) end)
+      end
+      self:_sendFile({ fd = fd, stat = stat }, options, function (err)
+        fs.close(fd, function () callback(err) end)
+      end)
+    end)
+  end)
+end
+
+-- Respond with file, a table with the stat and either the open fd or the
+-- whole content of the file, and an optional etag.
+function ServerResponse:_sendFile(file, options, callback)
+  local socket = self.socket
+  local headers = self.req and self.req.headers or {}
+  local stat = file.stat
+  local size = stat.size
+
+  local function fail(err)
+    socket:destroy()
+    callback(err)
+  end
+
+  local etag = options.etag
+  if etag ~= false then
+    if type(etag) ~= "string" then
+      etag = file.etag or format('"%x-%x"', stat.mtime.sec, size)
+    end
+    self:setHeader("ETag", etag)
+    local match = headers["if-none-match"]
+    if match and (match == "*" or find(match, etag, 1, true)) then
+      self.statusCode = 304
+      self:finish()
+      return callback()
+    end
+  end
+  if options.cacheControl then
+    self:setHeader("Cache-Control", options.cacheControl)
+  end
+
+  local offset, length = 0, size
+  if options.range ~= false then
+    self:setHeader("Accept-Ranges", "bytes")
+    local range = headers.range
+    if range then
+      local first, last = parseRange(range, size)
+      if first == false then
+        self.statusCode = 416
+        self:setHeader("Content-Range", "bytes */" .. size)
+        self:setHeader("Content-Length", 0)
+        self:finish()
+        return callback()
+      elseif first then
+        self.statusCode = 206
+        self:setHeader("Content-Range", format("bytes %d-%d/%d", first, last, size))
+        offset, length = first, last - first + 1
+      end
+    end
+  end
+
+  self:setHeader("Content-Length", length)
+  if length == 0 or (self.req and self.req.method == "HEAD") then
+    self:finish()
+    return callback()
+  end
+
+  if file.content then
+    self:finish(sub(file.content, offset + 1, offset + length))
+    return callback()
+  end
+
+  self.hasBody = true
+  self:flushHeaders()
+  local function onBody(err)
+    if err then return fail(err) end
+    self:finish()
+    callback()
+  end
+  if socket.ssl or ffi.os == "Windows" then
+    return streamFileBody(self, file.fd, offset, length, onBody)
+  end
+  sendFileBody(socket, file.fd, offset, length, onBody)
+end
+
+-- Buffers socket reads for an http decoder.  The decoder consumes the buffer
+-- by index so parsed data is never sliced off and copied, and reads that
+-- arrive while a message is incomplete are queued and only joined once there
+-- is enough data for the decoder to make progress.
+local function newInput(decode)
+  local buffer, index = "", 1
+  local queue = {}
+  local available = 0 -- unconsumed bytes in buffer and queue
+  local needed = 0 -- bytes the decoder is waiting for
+
+  local input = {}
+
+  -- Add data read from the socket, returns true if decoding can continue.
+  function input.push(chunk)
+    if index > #buffer and #queue == 0 then
+      buffer, index = chunk, 1
+    else
+      queue[#queue + 1] = chunk
+    end
+    available = available + #chunk
+    return available >= needed
+  end
+
+  -- Returns the next decoded event or nil if more data is needed.
+  function input.decode()
+    if #queue > 0 then
+      if index <= #buffer then
+        table.insert(queue, 1, sub(buffer, index))
+      end
+      buffer, index = concat(queue), 1
+      queue = {}
+    end
+    local event, nextIndex = decode(buffer, index)
+    if event == nil then
+      -- Wait for what the decoder asked for, or at least one more byte.
+      needed = nextIndex or available + 1
+      return
+    end
+    needed = 0
+    index = nextIndex
+    available = #buffer - index + 1
+    return event
+  end
+
+  -- Remove and return all the unconsumed data.
+  function input.rest()
+    if index <= #buffer then
+      table.insert(queue, 1, sub(buffer, index))
+    end
+    local rest = concat(queue)
+    buffer, index, queue, available, needed = "", 1, {}, 0, 0
+    return rest
+  end
+
+  return input
+end
+
 local function handleConnection(socket, onRequest)
 
   -- Initialize the two halves of the stateful decoder and encoder for HTTP.
-  local decode = codec.decoder()
+  local input = newInput(codec.decoder())
 
-  local buffer = ""
   local req, res
 
   local function flush()
@@ -229,15 +514,13 @@ local function handleConnection(socket, onRequest)
   end
 
   local function onData(chunk)
-    -- Run the chunk through the decoder by concatenating and looping
-    buffer = buffer .. chunk
+    -- Queue the chunk and run the decoder over it in a loop
+    if not input.push(chunk) then return end
     while true do
-      local R, event, extra = pcall(decode,buffer)
+      local R, event = pcall(input.decode)
       if R then
-        -- nil extra means the decoder needs more data, we're done here.
-        if not extra then break end
-        -- Store the leftover data.
-        buffer = extra
+        -- nil event means the decoder needs more data, we're done here.
+        if event == nil then break end
         if type(event) == "table" then
           -- If there was an old request that never closed, end it.
           if req then flush() end
@@ -245,6 +528,7 @@ local function handleConnection(socket, onRequest)
           req = IncomingMessage:new(event, socket)
           -- Create a new response object
           res = ServerResponse:new(socket)
+          res.req = req
           res.keepAlive = event.keepAlive
 
           -- If the request upgrades the protocol then detatch the listeners so http codec is no longer used
@@ -254,9 +538,10 @@ local function handleConnection(socket, onRequest)
             socket:removeListener("timeout", onTimeout)
             socket:removeListener("data", onData)
             socket:removeListener("end", onEnd)
-            if #buffer > 0 then
+            local rest = input.rest()
+            if #rest > 0 then
               socket:pause()
-              socket:unshift(buffer)
+              socket:unshift(rest)
             end
             onRequest(req, res)
             break
@@ -349,7 +634,7 @@ function ClientRequest:initialize(options, callback)
     self:once('response', callback)
   end
 
-  local buffer = ''
+  local input = newInput(self.decode)
   local res
 
   local function flush()
@@ -369,15 +654,13 @@ function ClientRequest:initialize(options, callback)
     self:emit('socket', socket)
 
     local function onData(chunk)
-      -- Run the chunk through the decoder by concatenating and looping
-      buffer = buffer .. chunk
+      -- Queue the chunk and run the decoder over it in a loop
+      if not input.push(chunk) then return end
       while true do
-        local R, event, extra = pcall(self.decode,buffer)
+        local R, event = pcall(input.decode)
         if R==true then
-          -- nil extra means the decoder needs more data, we're done here.
-          if not extra then return end
-          -- Store the leftover data.
-          buffer = extra
+          -- nil event means the decoder needs more data, we're done here.
+          if event == nil then return end
           if type(event) == "table" then
             if not res then
               flush()
@@ -389,9 +672,10 @@ function ClientRequest:initialize(options, callback)
                 socket:removeListener('data', onData)
                 socket:removeListener('end', flush)
                 socket:read(0)
-                if #buffer > 0 then
+                local rest = input.rest()
+                if #rest > 0 then
                   socket:pause()
-                  socket:unshift(buffer)
+                  socket:unshift(rest)
                 end
                 return self:emit(evt, res, socket, event)
               elseif self.method == 'CONNECT' or res.statusCode == 101 then
@@ -0,0 +1,393 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+--[[lit-meta
+  name = "luvit/log"
+  version = "2.0.0"
+  dependencies = {
+    "luvit/core@2.0.0",
+    "luvit/json@2.5.1",
+  }
+  license = "Apache 2"
+  homepage = "https://github.com/luvit/luvit/blob/master/deps/log.lua"
+  description = "Buffered, rotating file logger with structured fields."
+  tags = {"luvit", "log", "logger"}
+]]
+
+--[[
+Log lines are formatted right away and queued in a ring buffer.  A timer
+flushes the queue every flushInterval ms with one vectored write on the
+threadpool, so logging never blocks the loop on the disk.  Lines queued
+when the process exits are written synchronously.
+
+  local log = require('log')
+  local logger = log.new({ path = "app.log", maxSize = 10 * 1024 * 1024 })
+  logger:info("request done", { path = "/", ms = 3 })
+  local child = logger:child({ requestId = 42 })
+  child:warn("slow")
+
+Options:
+
+  path: file to append to, otherwise fd is written to (stderr by default)
+  level: lowest level written, "debug", "info" (default), "warn" or "error"
+  format: "text" (default) for `time LEVEL message key=value` lines or
+          "json" for one json object per line
+  fields: fields added to every line
+  capacity: lines the ring buffer holds (8192 by default).  Once it's full
+            and a write is still in flight new lines are dropped and
+            counted; a note with the count is logged with the next write.
+  flushInterval: ms between flushes (100 by default)
+  maxSize: rotate the file before it grows past this many bytes
+  maxFiles: rotated files kept as path.1 .. path.N (5 by default)
+]]
+
+local uv = require('uv')
+local json = require('json')
+local Object = require('core').Object
+
+local concat = table.concat
+local format = string.format
+local date = os.date
+
+local levels = { debug = 10, info = 20, warn = 30, error = 40 }
+local levelNames = { debug = "DEBUG", info = "INFO", warn = "WARN", error = "ERROR" }
+
+-- Timestamps are formatted once per second and get the milliseconds added
+local lastSecond, lastDate
+local function timestamp()
+  local sec, usec
+  if uv.gettimeofday then
+    sec, usec = uv.gettimeofday()
+  else
+    sec, usec = os.time(), 0
+  end
+  if sec ~= lastSecond then
+    lastSecond = sec
+    lastDate = date("!%Y-%m-%dT%H:%M:%S", sec)
+  end
+  return format("%s.%03dZ", lastDate, math.floor(usec / 1000))
+end
+
+local function textValue(value)
+  value = tostring(value)
+  if value == "" or value:find('[%s"=]') then
+    return (format("%q", value):gsub("\\\n", "\\n"))
+  end
+  return value
+end
+
+-- Append the fields of each table as sorted key=value pairs
+local function textFields(parts, ...)
+  for i = 1, select('#', ...) do
+    local fields = select(i, ...)
+    if fields then
+      local keys = {}
+      for key in pairs(fields) do
+        keys[#keys + 1] = tostring(key)
+      end
+      table.sort(keys)
+      for j = 1, #keys do
+        local key = keys[j]
+        parts[#parts + 1] = key .. "=" .. textValue(fields[key])
+      end
+    end
+  end
+end
+
+local function formatText(level, message, base, fields)
+  local parts = { timestamp(), levelNames[level], (tostring(message):gsub("\n", "\\n")) }
+  textFields(parts, base, fields)
+  return concat(parts, " ") .. "\n"
+end
+
+local function formatJson(level, message, base, fields)
+  local record = {}
+  if base then
+    for key, value in pairs(base) do record[key] = value end
+  end
+  if fields then
+    for key, value in pairs(fields) do record[key] = value end
+  end
+  record.time = timestamp()
+  record.level = level
+  record.msg = message
+  return json.stringify(record) .. "\n"
+end
+
+local Logger = Object:extend()
+
+function Logger:initialize(options)
+  options = options or {}
+  self.path = options.path
+  self.fd = options.fd or (not self.path and 2) or nil
+  self.level = levels[options.level or "info"]
+  if not self.level then error("Unknown log level " .. tostring(options.level)) end
+  self.formatLine = options.format == "json" and formatJson or formatText
+  self.fields = options.fields
+  self.capacity = options.capacity or 8192
+  self.maxSize = options.maxSize
+  self.maxFiles = options.maxFiles or 5
+
+  -- Ring buffer of formatted lines
+  self.ring = {}
+  self.first = 1
+  self.count = 0
+  self.queuedBytes = 0
+
+  self.size = 0
+  self.dropped = 0
+  self.written = 0
+  self.writing = false
+
+  if self.path then
+    local fd = assert(uv.fs_open(self.path, "a", 420 --[[ 0644 ]]))
+    self.fd = fd
+    local stat = uv.fs_fstat(fd)
+    self.size = stat and stat.size or 0
+  end
+
+  self.timer = uv.new_timer()
+  uv.timer_start(self.timer, options.flushInterval or 100,
+    options.flushInterval or 100, function ()
+      if self.count > 0 then self:flush() end
+    end)
+  uv.unref(self.timer)
+
+  self.onExit = function ()
+    self:flushSync()
+  end
+  process:on('exit', self.onExit)
+end
+
+-- Queue a line, returns false if it was dropped
+function Logger:_push(line)
+  if self.count >= self.capacity then
+    if not self.writing then self:flush() end
+    if self.count >= self.capacity then
+      self.dropped = self.dropped + 1
+      return false
+    end
+  end
+  local capacity = self.capacity
+  local index = (self.first + self.count - 1) % capacity + 1
+  self.ring[index] = line
+  self.count = self.count + 1
+  self.queuedBytes = self.queuedBytes + #line
+  return true
+end
+
+-- Take every queued line out of the ring, oldest first
+function Logger:_take()
+  local lines = {}
+  local ring, capacity = self.ring, self.capacity
+  local index = self.first
+  if self.dropped > 0 then
+    lines[1] = self.formatLine("warn", "log lines dropped", nil,
+      { dropped = self.dropped })
+    self.dropped = 0
+  end
+  local n = #lines
+  for i = 1, self.count do
+    lines[n + i] = ring[index]
+    ring[index] = nil
+    index = index % capacity + 1
+  end
+  self.first = index
+  self.count = 0
+  self.queuedBytes = 0
+  return lines
+end
+
+function Logger:log(level, message, fields)
+  local value = levels[level]
+  if not value then error("Unknown log level " .. tostring(level)) end
+  if value < self.level or self.closed then return end
+  local root = self.parent or self
+  return root:_push(self.formatLine(level, message, self.fields, fields))
+end
+
+function Logger:debug(message, fields) return self:log("debug", message, fields) end
+function Logger:info(message, fields) return self:log("info", message, fields) end
+function Logger:warn(message, fields) return self:log("warn", message, fields) end
+function Logger:error(message, fields) return self:log("error", message, fields) end
+
+-- A logger writing to the same queue with extra fields on every line
+function Logger:child(fields)
+  local merged = {}
+  if self.fields then
+    for key, value in pairs(self.fields) do merged[key] = value end
+  end
+  for key, value in pairs(fields) do merged[key] = value end
+  return setmetatable({
+    fields = merged,
+    parent = self.parent or self,
+  }, { __index = self })
+end
+
+-- Move path to path.1, path.1 to path.2 and so on, dropping the oldest,
+-- then reopen path.  Calls callback(err) once done.
+function Logger:_rotate(callback)
+  local path = self.path
+  local oldFd = self.fd
+  local function reopen()
+    uv.fs_open(path, "a", 420 --[[ 0644 ]], function (err, fd)
+      if err then return callback(err) end
+      self.fd = fd
+      self.size = 0
+      uv.fs_close(oldFd, function () callback() end)
+    end)
+  end
+  local function shift(i)
+    if i < 1 then
+      return uv.fs_rename(path, path .. ".1", function () reopen() end)
+    end
+    uv.fs_rename(path .. "." .. i, path .. "." .. (i + 1), function ()
+      shift(i - 1)
+    end)
+  end
+  uv.fs_unlink(path .. "." .. self.maxFiles, function ()
+    shift(self.maxFiles - 1)
+  end)
+end
+
+-- Write everything queued so far with one vectored write.  callback(err)
+-- runs once it's on disk (or right away when the queue is empty).
+function Logger:flush(callback)
+  if self.writing then
+    -- Runs again when the write in flight is done
+    if callback then
+      self.waiting = self.waiting or {}
+      self.waiting[#self.waiting + 1] = callback
+    end
+    self.again = true
+    return
+  end
+  if self.count == 0 and self.dropped == 0 then
+    if callback then callback() end
+    return
+  end
+  self.writing = true
+  local bytes = self.queuedBytes
+  local lines = self:_take()
+  -- flushSync writes these itself if the process exits before they're out
+  self.inflight = lines
+
+  local function done(err)
+    self.writing = false
+    local waiting = self.waiting
+    self.waiting = nil
+    if err then self.errors = (self.errors or 0) + 1 end
+    if callback then callback(err) end
+    if waiting then
+      for i = 1, #waiting do waiting[i](err) end
+    end
+    if self.again then
+      self.again = false
+      self:flush()
+    end
+  end
+
+  local function write()
+    -- Already written by flushSync while rotating
+    if self.inflight ~= lines then return done() end
+    self.inflightReq = uv.fs_write(self.fd, lines, -1, function (err, written)
+      self.inflightReq = nil
+      if self.inflight ~= lines then return done() end
+      self.inflight = nil
+      if not err then
+        self.size = self.size + written
+        self.written = self.written + #lines
+      end
+      done(err)
+    end)
+  end
+
+  if self.path and self.maxSize and self.size > 0 and
+      self.size + bytes > self.maxSize then
+    return self:_rotate(function (err)
+      if err then return done(err) end
+      write()
+    end)
+  end
+  write()
+end
+
+local function writeSync(self, lines)
+  -- self.fd is the current file, also right after a rotation
+  local written = uv.fs_write(self.fd, lines, -1)
+  if written then
+    self.size = self.size + written
+    self.written = self.written + #lines
+  end
+end
+
+-- Write out what's queued right now, blocking.  Used at exit.  Lines of a
+-- flush still in flight go first, unless the threadpool already started
+-- writing them, then they land before these anyway.
+function Logger:flushSync()
+  if not self.fd then return end
+  local inflight = self.inflight
+  if inflight then
+    self.inflight = nil
+    local req = self.inflightReq
+    if not req or uv.cancel(req) then
+      writeSync(self, inflight)
+    end
+  end
+  if self.count == 0 and self.dropped == 0 then return end
+  writeSync(self, self:_take())
+end
+
+-- Flush, then close the file and stop the timer
+function Logger:close(callback)
+  if self.closed then
+    if callback then callback() end
+    return
+  end
+  self:flush(function ()
+    self.closed = true
+    uv.close(self.timer)
+    process:removeListener('exit', self.onExit)
+    if self.path then
+      return uv.fs_close(self.fd, function ()
+        if callback then callback() end
+      end)
+    end
+    if callback then callback() end
+  end)
+end
+
+function Logger:stats()
+  return {
+    queued = self.count,
+    written = self.written,
+    dropped = self.dropped,
+    errors = self.errors or 0,
+    size = self.size,
+  }
+end
+
+local function new(options)
+  return Logger:new(options)
+end
+
+return {
+  Logger = Logger,
+  levels = levels,
+  new = new,
+}
@@ -18,12 +18,13 @@ limitations under the License.
 
 --[[lit-meta
   name = "luvit/net"
-  version = "2.0.4"
+  version = "2.6.0"
   dependencies = {
     "luvit/timer@2.0.0",
-    "luvit/utils@2.0.0",
+    "luvit/utils@2.2.0",
     "luvit/core@2.0.0",
     "luvit/stream@2.0.0",
+    "luvit/buffer@2.5.0",
   }
   license = "Apache 2"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/net.lua"
@@ -32,10 +33,95 @@ limitations under the License.
 ]]
 
 local uv = require('uv')
+local ffi = require('ffi')
 local timer = require('timer')
 local utils = require('utils')
 local Emitter = require('core').Emitter
 local Duplex = require('stream').Duplex
+local Pool = require('buffer').Pool
+
+--[[ SO_REUSEPORT ]]--
+
+local SOL_SOCKET, SO_REUSEPORT
+if ffi.os == "Linux" then
+  if ffi.arch == "mips" or ffi.arch == "mipsel" then
+    SOL_SOCKET = 0xffff
+    SO_REUSEPORT = 0x0200
+  else
+    SOL_SOCKET = 1
+    SO_REUSEPORT = 15
+  end
+elseif ffi.os == "OSX" or ffi.os == "BSD" then
+  SOL_SOCKET = 0xffff
+  SO_REUSEPORT = 0x0200
+  -- Plain SO_REUSEPORT only shares the address there, FreeBSD 12+ balances
+  -- connections between the sockets with SO_REUSEPORT_LB
+  local ok, uname = pcall(uv.os_uname)
+  if ok and uname and uname.sysname == "FreeBSD" then
+    SO_REUSEPORT = 0x00010000
+  end
+end
+
+-- Lets several processes bind their own socket to the same address.  On
+-- Linux and FreeBSD the kernel spreads incoming connections between them;
+-- macOS and the other BSDs allow the shared bind but don't balance.  Must
+-- be called on a tcp handle that has a socket (created with a family) but
+-- isn't bound yet.
+local function setReusePort(handle)
+  if not SO_REUSEPORT then
+    error("reusePort is not supported on " .. ffi.os)
+  end
+  pcall(ffi.cdef, [[
+    int setsockopt(int sockfd, int level, int optname, const void *optval, unsigned int optlen);
+  ]])
+  local fd = assert(uv.fileno(handle))
+  local one = ffi.new("int[1]", 1)
+  if ffi.C.setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, one, ffi.sizeof("int")) ~= 0 then
+    error("setsockopt(SO_REUSEPORT) failed: " .. ffi.errno())
+  end
+end
+
+--[[ readInto ]]--
+
+local EAGAIN = (ffi.os == "OSX" or ffi.os == "BSD") and 35 or 11
+local EINTR = 4
+
+local readIntoDefined = false
+local function defineReadInto()
+  if readIntoDefined then return end
+  readIntoDefined = true
+  pcall(ffi.cdef, "int dup(int oldfd);")
+  pcall(ffi.cdef, "int close(int fd);")
+  pcall(ffi.cdef, "ssize_t recv(int sockfd, void *buf, size_t len, int flags);")
+end
+
+local writevDefined = false
+local function defineWritev()
+  if writevDefined then return end
+  writevDefined = true
+  defineReadInto()
+  pcall(ffi.cdef, "struct iovec { void *iov_base; size_t iov_len; };")
+  pcall(ffi.cdef, "ssize_t writev(int fd, const struct iovec *iov, int iovcnt);")
+end
+
+local IOV_MAX = 1024
+
+-- Append the strings and Buffers of data to list, returns whether any of
+-- them is a Buffer
+local function flattenChunks(list, data)
+  if type(data) ~= 'table' then
+    list[#list + 1] = data
+    return false
+  elseif utils.isBuffer(data) then
+    list[#list + 1] = data
+    return true
+  end
+  local found = false
+  for i = 1, #data do
+    if flattenChunks(list, data[i]) then found = true end
+  end
+  return found
+end
 
 --[[ Socket ]]--
 
@@ -78,6 +164,8 @@ end
 
 function Socket:_onSocketEnd()
   self:once('end', function()
+    -- A half open socket stays writable until it is shut down
+    if self.allowHalfOpen then return end
     self:destroy()
   end)
 end
@@ -102,7 +190,18 @@ end
 
 function Socket:_write(data, callback)
   if not self._handle then return end
-  uv.write(self._handle, data, function(err)
+  -- Buffers are written from their own memory once the socket has an fd
+  -- and nothing is queued in libuv ahead of them
+  if ffi.os ~= "Windows" and type(data) == 'table' and
+      not self._connecting and uv.fileno(self._handle) and
+      uv.stream_get_write_queue_size(self._handle) == 0 then
+    local list = {}
+    if flattenChunks(list, data) then
+      return self:_writeDirect(list, callback)
+    end
+  end
+  -- Strings, and Buffers on Windows, go through libuv as Lua strings
+  uv.write(self._handle, utils.toWriteData(data), function(err)
     if err then
       self:destroy(err)
       return callback(err)
@@ -111,6 +210,79 @@ function Socket:_write(data, callback)
   end)
 end
 
+-- Write a list of strings and Buffers with writev(2) on the dup'd fd,
+-- straight from their memory, so no Lua string is made of a Buffer.  When
+-- the socket is full the rest goes out once it's writable again.  list
+-- keeps every chunk alive until callback runs.
+function Socket:_writeDirect(list, callback)
+  defineWritev()
+  local fd = self:_getWriteFd()
+  if not fd then
+    local err = "EDUP: dup failed with errno " .. ffi.errno()
+    self:destroy(err)
+    return callback(err)
+  end
+  local count = #list
+  local iov = ffi.new("struct iovec[?]", count)
+  for i = 1, count do
+    local chunk = list[i]
+    local entry = iov[i - 1]
+    if type(chunk) == 'string' then
+      entry.iov_base = ffi.cast("void*", chunk)
+      entry.iov_len = #chunk
+    else
+      entry.iov_base = ffi.cast("void*", chunk.ctype)
+      entry.iov_len = chunk.length
+    end
+  end
+
+  local first = 0 -- first iovec not fully written
+  local function attempt(err)
+    if err then
+      self:destroy(err)
+      return callback(err)
+    end
+    if self.destroyed then return end
+    while first < count do
+      local n = tonumber(ffi.C.writev(fd, iov + first,
+        math.min(count - first, IOV_MAX)))
+      if n < 0 then
+        local errno = ffi.errno()
+        if errno == EAGAIN then
+          return self:_waitWritable(attempt)
+        elseif errno ~= EINTR then
+          err = "EWRITEV: writev failed with errno " .. errno
+          self:destroy(err)
+          return callback(err)
+        end
+      else
+        -- Skip what went out, the last entry may be written partly
+        while first < count and n >= tonumber(iov[first].iov_len) do
+          n = n - tonumber(iov[first].iov_len)
+          first = first + 1
+        end
+        if n > 0 then
+          local entry = iov[first]
+          entry.iov_base = ffi.cast("char*", entry.iov_base) + n
+          entry.iov_len = entry.iov_len - n
+        end
+      end
+    end
+    list = nil
+    callback()
+  end
+  attempt()
+end
+
+-- Buffered chunks go out as one uv.write so the kernel sees one writev
+function Socket:_writev(requests, callback)
+  local chunks = {}
+  for i = 1, #requests do
+    chunks[i] = requests[i].chunk
+  end
+  self:_write(chunks, callback)
+end
+
 function Socket:_read(n)
   local onRead
 
@@ -130,10 +302,102 @@ function Socket:_read(n)
     self:once('connect', utils.bind(self._read, self, n))
   elseif not self._reading then
     self._reading = true
-    uv.read_start(self._handle, onRead)
+    if self._readPool then
+      self:_pollRead()
+    else
+      uv.read_start(self._handle, onRead)
+    end
   end
 end
 
+-- Read into Buffers from pool (a buffer.Pool) instead of creating a Lua
+-- string per read.  Data is pushed as Buffer chunks, each in a pool buffer
+-- of its own; give them back with pool:release(chunk) once they have been
+-- written or parsed.  The fd is dup'd and watched by a uv poll handle so
+-- recv can fill ffi memory directly.  Not available on Windows.
+function Socket:readInto(pool)
+  if ffi.os == "Windows" then
+    error("readInto is not supported on Windows")
+  end
+  if self.encrypted then
+    -- The fd carries ciphertext, only the TLS layer can read it
+    error("readInto is not supported on TLS sockets")
+  end
+  defineReadInto()
+  self._readPool = pool
+  if self._reading and not self._readPoll then
+    uv.read_stop(self._handle)
+    self._reading = false
+    self:_read(0)
+  end
+  return self
+end
+
+function Socket:_pollRead()
+  if not self._readPoll then
+    local fd = ffi.C.dup(assert(uv.fileno(self._handle)))
+    if fd < 0 then
+      return self:destroy("EDUP: dup failed with errno " .. ffi.errno())
+    end
+    self._readFd = fd
+    self._readPoll = uv.new_poll(fd)
+  end
+  uv.poll_start(self._readPoll, 'r', function(err)
+    timer.active(self)
+    if err then
+      return self:destroy(err)
+    end
+    local pool = self._readPool
+    local buf = pool:get()
+    local n = tonumber(ffi.C.recv(self._readFd, buf.ctype, buf.length, 0))
+    if n > 0 then
+      if not self:push(buf:slice(1, n)) and self._reading then
+        -- Wait for the consumer to call _read again
+        self._reading = false
+        uv.poll_stop(self._readPoll)
+      end
+      return
+    end
+    pool:release(buf)
+    if n == 0 then
+      self._reading = false
+      uv.poll_stop(self._readPoll)
+      self:push(nil)
+      self:emit('_socketEnd')
+    else
+      local errno = ffi.errno()
+      if errno ~= EAGAIN and errno ~= EINTR then
+        self:destroy("ERECV: recv failed with errno " .. errno)
+      end
+    end
+  end)
+end
+
+-- A dup of the socket's fd with a poll handle on it, for writes made
+-- outside of libuv.  Returns nil if dup fails.
+function Socket:_getWriteFd()
+  if not self._writePoll then
+    defineReadInto()
+    local fd = ffi.C.dup(assert(uv.fileno(self._handle)))
+    if fd < 0 then return end
+    self._writeFd = fd
+    self._writePoll = uv.new_poll(fd)
+  end
+  return self._writeFd
+end
+
+-- Call callback(err) once the socket can take more data.  For writes made
+-- to the fd behind the stream's back, like sendfile(2) from http.
+function Socket:_waitWritable(callback)
+  if not self:_getWriteFd() then
+    return callback("EDUP: dup failed with errno " .. ffi.errno())
+  end
+  uv.poll_start(self._writePoll, 'w', function(err)
+    uv.poll_stop(self._writePoll)
+    callback(err)
+  end)
+end
+
 function Socket:shutdown(callback)
   if self.destroyed == true and callback then
     return callback()
@@ -176,7 +440,11 @@ function Socket:pause()
   Duplex.pause(self)
   if not self._handle then return end
   self._reading = false
-  uv.read_stop(self._handle)
+  if self._readPoll then
+    uv.poll_stop(self._readPoll)
+  else
+    uv.read_stop(self._handle)
+  end
 end
 
 function Socket:resume()
@@ -254,6 +522,21 @@ function Socket:destroy(exception, callback)
   self.readable = false
   self.writable = false
 
+  if self._readPoll then
+    local fd = self._readFd
+    uv.close(self._readPoll, function()
+      ffi.C.close(fd)
+    end)
+    self._readPoll = nil
+  end
+  if self._writePoll then
+    local fd = self._writeFd
+    uv.close(self._writePoll, function()
+      ffi.C.close(fd)
+    end)
+    self._writePoll = nil
+  end
+
   if uv.is_closing(self._handle) then
     timer.setImmediate(callback)
   else
@@ -301,6 +584,7 @@ function Server:init(options, connectionListener)
   if options.handle then
     self._handle = options.handle
   end
+  self._reusePort = options.reusePort
 end
 
 function Server:destroy(err, callback)
@@ -310,13 +594,17 @@ end
 function Server:listen(port, ... --[[ ip, callback --]] )
   local args = {...}
   local ip, callback
+  local reusePort = self._reusePort
 
-  if not self._handle then
-    self._handle = Socket:new({ handle = uv.new_tcp() })
-  end
-
+  if type(port) == 'table' then
+    -- listen(options, [cb])
+    local options = port
+    port = options.port
+    ip = options.host
+    if options.reusePort ~= nil then reusePort = options.reusePort end
+    callback = args[1]
   -- Future proof
-  if type(args[1]) == 'function' then
+  elseif type(args[1]) == 'function' then
     callback = args[1]
   else
     ip = args[1]
@@ -325,6 +613,23 @@ function Server:listen(port, ... --[[ ip, callback --]] )
 
   ip = ip or '0.0.0.0'
 
+  if reusePort and self._handle then
+    -- The option has to be set before the socket is bound
+    error("reusePort can't be set on a server that already has a handle")
+  end
+
+  if not self._handle then
+    local handle
+    if reusePort then
+      -- The socket has to exist before bind to set options on it
+      handle = uv.new_tcp(ip:find(':') and 'inet6' or 'inet')
+      setReusePort(handle)
+    else
+      handle = uv.new_tcp()
+    end
+    self._handle = Socket:new({ handle = handle })
+  end
+
   self._handle:bind(ip, port)
   self._handle:listen()
   self._handle:on('connection', function(client)
@@ -349,6 +654,276 @@ function Server:close(callback)
   self:destroy(nil, callback)
 end
 
+--[[ pipeSockets ]]--
+
+local SPLICE_FLAGS = 3 -- SPLICE_F_MOVE | SPLICE_F_NONBLOCK
+local O_NONBLOCK = (ffi.arch == "mips" or ffi.arch == "mipsel") and 0x80 or 0x800
+
+local spliceDefined = false
+local function defineSplice()
+  if spliceDefined then return end
+  spliceDefined = true
+  defineReadInto()
+  pcall(ffi.cdef, "int pipe2(int pipefd[2], int flags);")
+  pcall(ffi.cdef, [[
+    ssize_t splice(int fd_in, int64_t *off_in, int fd_out, int64_t *off_out,
+                   size_t len, unsigned int flags);
+  ]])
+end
+
+-- Stop the stream reading from the socket and take what it has buffered.
+local function takeBuffered(socket)
+  socket:pause()
+  local state = socket._readableState
+  local list = state.buffer
+  local parts = {}
+  for i = list.head, list.tail do
+    parts[#parts + 1] = tostring(list[i])
+  end
+  if #parts > 0 then
+    parts[1] = parts[1]:sub(list.offset + 1)
+  end
+  state.buffer = { head = 1, tail = 0, offset = 0 }
+  state.length = 0
+  return table.concat(parts)
+end
+
+-- Linux: move bytes socket -> pipe -> socket with splice(2) so they never
+-- leave the kernel.  A side is only read once its pipe has been drained
+-- into the other side, which is all the backpressure there is to it.
+local function spliceSockets(pipe, a, b, chunkSize, finish)
+  local C = ffi.C
+  local sides = {}
+  local directions = {}
+  local closing = false
+
+  local function cleanup()
+    if closing then return end
+    closing = true
+    for _, side in ipairs(sides) do
+      local fd = side.fd
+      uv.close(side.poll, function ()
+        C.close(fd)
+      end)
+    end
+    for _, dir in ipairs(directions) do
+      C.close(dir.pipeR)
+      C.close(dir.pipeW)
+    end
+  end
+
+  local function fail(message)
+    cleanup()
+    finish(message)
+  end
+
+  local function update(side)
+    local events = ""
+    local outgoing, incoming = side.outgoing, side.incoming
+    if not outgoing.eof and outgoing.pending == 0 then
+      events = "r"
+    end
+    if incoming.blocked then
+      events = events .. "w"
+    end
+    if events == side.events then return end
+    side.events = events
+    if events == "" then
+      uv.poll_stop(side.poll)
+    else
+      uv.poll_start(side.poll, events, side.onEvent)
+    end
+  end
+
+  local function flush(dir)
+    while dir.pending > 0 do
+      local n = tonumber(C.splice(dir.pipeR, nil, dir.to.fd, nil, dir.pending, SPLICE_FLAGS))
+      if n > 0 then
+        dir.pending = dir.pending - n
+        pipe[dir.counter] = pipe[dir.counter] + n
+      else
+        local errno = ffi.errno()
+        if n == 0 or errno == EAGAIN then break end
+        if errno ~= EINTR then
+          return fail("ESPLICE: splice failed with errno " .. errno)
+        end
+      end
+    end
+    dir.blocked = dir.pending > 0
+    if dir.eof and dir.pending == 0 and not dir.done then
+      dir.done = true
+      uv.shutdown(dir.to.socket._handle)
+      pipe:emit('end', dir.name)
+      if directions[1].done and directions[2].done then
+        cleanup()
+        return finish()
+      end
+    end
+    update(dir.from)
+    update(dir.to)
+  end
+
+  local function fill(dir)
+    local n = tonumber(C.splice(dir.from.fd, nil, dir.pipeW, nil, chunkSize, SPLICE_FLAGS))
+    if n > 0 then
+      dir.pending = dir.pending + n
+    elseif n == 0 then
+      dir.eof = true
+    else
+      local errno = ffi.errno()
+      if errno == EAGAIN or errno == EINTR then return end
+      return fail("ESPLICE: splice failed with errno " .. errno)
+    end
+    flush(dir)
+  end
+
+  for i, socket in ipairs({ a, b }) do
+    local fd = C.dup(assert(uv.fileno(socket._handle)))
+    if fd < 0 then
+      return fail("EDUP: dup failed with errno " .. ffi.errno())
+    end
+    local side = { socket = socket, fd = fd, poll = uv.new_poll(fd), events = "" }
+    function side.onEvent(err, events)
+      if closing then return end
+      timer.active(socket)
+      if err then return fail(err) end
+      if events:find("w", 1, true) then flush(side.incoming) end
+      if closing then return end
+      if events:find("r", 1, true) then fill(side.outgoing) end
+    end
+    sides[i] = side
+  end
+
+  for i, name in ipairs({ "a", "b" }) do
+    local fds = ffi.new("int[2]")
+    if C.pipe2(fds, O_NONBLOCK) ~= 0 then
+      return fail("EPIPE2: pipe2 failed with errno " .. ffi.errno())
+    end
+    local from, to = sides[i], sides[3 - i]
+    local dir = {
+      name = name == "a" and "aToB" or "bToA",
+      counter = name == "a" and "bytesAtoB" or "bytesBtoA",
+      from = from, to = to,
+      pipeR = fds[0], pipeW = fds[1],
+      pending = 0,
+    }
+    from.outgoing = dir
+    to.incoming = dir
+    directions[i] = dir
+  end
+
+  update(sides[1])
+  update(sides[2])
+  return cleanup
+end
+
+-- Everywhere else: stream both ways, reading into pooled Buffers when the
+-- platform allows and pausing a side while the other one drains.
+local function streamSockets(pipe, a, b, chunkSize, finish)
+  local pool = ffi.os ~= "Windows" and Pool:new(chunkSize) or nil
+  local shut = 0
+
+  local function forward(from, to, name, counter)
+    if pool and not from.encrypted then from:readInto(pool) end
+    local function release(chunk)
+      return function ()
+        if pool then pool:release(chunk) end
+      end
+    end
+    from:on('data', function (chunk)
+      pipe[counter] = pipe[counter] + (type(chunk) == "string" and #chunk or chunk.length)
+      if not to:write(chunk, release(chunk)) then
+        from:pause()
+        to:once('drain', function ()
+          from:resume()
+        end)
+      end
+    end)
+    from:on('end', function ()
+      pipe:emit('end', name)
+      -- Half close once everything written so far is out, and only tear
+      -- both sockets down once both directions are shut down
+      to:write("", function (err)
+        if err then return finish(err) end
+        to:shutdown(function (err)
+          if err then return finish(err) end
+          shut = shut + 1
+          if shut == 2 then finish() end
+        end)
+      end)
+    end)
+    from:resume()
+  end
+
+  forward(a, b, "aToB", "bytesAtoB")
+  forward(b, a, "bToA", "bytesBtoA")
+end
+
+-- Forward bytes between two connected sockets in both directions until
+-- both sides have ended.  Returns an emitter with byte counters bytesAtoB
+-- and bytesBtoA that emits 'end' (direction) when a side finishes, 'error'
+-- and finally 'close' after both sockets are destroyed.
+--
+-- On Linux the bytes are moved with splice(2) and never reach Lua; set
+-- options.splice = false to stream them through Lua instead.  TLS sockets
+-- are always streamed, their fds carry ciphertext.  Data already buffered
+-- in either socket is sent first.  Don't write to or read from the sockets
+-- yourself while they are piped.
+local function pipeSockets(a, b, options)
+  options = options or {}
+  local chunkSize = options.chunkSize or 64 * 1024
+  local useSplice = options.splice ~= false and ffi.os == "Linux" and
+    not a.encrypted and not b.encrypted
+
+  local pipe = Emitter:new()
+  pipe.bytesAtoB = 0
+  pipe.bytesBtoA = 0
+
+  local closed = false
+  local cleanup
+
+  local function finish(err)
+    if closed then return end
+    closed = true
+    if cleanup then cleanup() end
+    a:destroy()
+    b:destroy()
+    if err then pipe:emit('error', err) end
+    pipe:emit('close')
+  end
+
+  -- Each side is shut down on its own once the other one ended
+  a.allowHalfOpen = true
+  b.allowHalfOpen = true
+  a:on('error', finish)
+  b:on('error', finish)
+  a:on('close', function () finish() end)
+  b:on('close', function () finish() end)
+
+  if not useSplice then
+    streamSockets(pipe, a, b, chunkSize, finish)
+    return pipe
+  end
+
+  defineSplice()
+
+  -- Flush what the streams already hold or have queued before the kernel
+  -- starts writing to the sockets behind their backs.
+  local waiting = 2
+  local function onFlushed()
+    waiting = waiting - 1
+    if waiting > 0 or closed then return end
+    cleanup = spliceSockets(pipe, a, b, chunkSize, finish)
+  end
+  local fromA, fromB = takeBuffered(a), takeBuffered(b)
+  pipe.bytesAtoB = #fromA
+  pipe.bytesBtoA = #fromB
+  b:write(fromA, onFlushed)
+  a:write(fromB, onFlushed)
+
+  return pipe
+end
+
 -- Exports
 
 local function createConnection(port, ... --[[ host, cb --]])
@@ -386,4 +961,5 @@ return {
   createConnection = createConnection,
   connect = createConnection,
   createServer = createServer,
+  pipeSockets = pipeSockets,
 }
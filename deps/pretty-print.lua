@@ -17,7 +17,7 @@ limitations under the License.
 --]]
 --[[lit-meta
   name = "luvit/pretty-print"
-  version = "2.1.1"
+  version = "2.2.0"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/pretty-print.lua"
   description = "A lua value pretty printer and colorizer for terminals."
   tags = {"colors", "tty"}
@@ -297,24 +297,120 @@ function dump(value, recurse, nocolor)
   return nocolor and strip(s) or s
 end
 
+-- Set once flushSync ran: handles stay blocking and print() writes straight
+-- through, since the loop may never run again to drain a queue.
+local syncWrites = false
+
+-- Write all of s before returning.  When the handle is full it's switched
+-- to blocking for the rest of the write rather than spinning on EAGAIN.
+-- Gives up with EAGAIN if writes are still queued on the handle, those
+-- have to go out first.
+local MAX_EAGAIN = 16
+local function writeSync(handle, s)
+  local blocking = syncWrites
+  local retries = 0
+  local ok, e = true, nil
+  while #s > 0 do
+    local n
+    n, e = uv.try_write(handle, s)
+    if n then
+      s = s:sub(n + 1)
+    elseif not e:match('^EAGAIN') or retries >= MAX_EAGAIN or
+        uv.stream_get_write_queue_size(handle) > 0 then
+      ok = false
+      break
+    else
+      retries = retries + 1
+      if not blocking then
+        blocking = pcall(uv.stream_set_blocking, handle, true)
+      end
+    end
+  end
+  if blocking and not syncWrites then
+    pcall(uv.stream_set_blocking, handle, false)
+  end
+  if not ok then return nil, e, s end
+  return true
+end
+
+-- Output to a tty goes out a line at a time.  Pipes and files are block
+-- buffered: lines collect until BUFFER_SIZE bytes are waiting or the loop
+-- is about to block for events, then go out with one write.  Use flush to
+-- push them out early and flushSync at exit.
+local BUFFER_SIZE = 64 * 1024
+local ttys = {} -- handle -> is a tty, guess_handle costs a syscall
+local buffers = {} -- handle -> list of pending strings
+local bufferedBytes = {}
+local flusher
+
+local function isTTY(handle)
+  local tty = ttys[handle]
+  if tty == nil then
+    tty = uv.guess_handle(uv.fileno(handle)) == 'tty'
+    ttys[handle] = tty
+  end
+  return tty
+end
+
+local function flush(handle)
+  local buffer = buffers[handle]
+  if not buffer then return end
+  buffers[handle] = nil
+  bufferedBytes[handle] = nil
+  uv.write(handle, buffer)
+end
+
+local function flushAll()
+  uv.prepare_stop(flusher)
+  for handle in pairs(buffers) do
+    flush(handle)
+  end
+end
+
+-- Write out everything buffered with blocking writes before returning, for
+-- use at exit.  From then on print() doesn't buffer any more.
+local function flushSync()
+  syncWrites = true
+  if flusher then uv.prepare_stop(flusher) end
+  for _, handle in pairs({ stdout, stderr }) do
+    pcall(uv.stream_set_blocking, handle, true)
+  end
+  for handle, buffer in pairs(buffers) do
+    buffers[handle] = nil
+    bufferedBytes[handle] = nil
+    pcall(uv.stream_set_blocking, handle, true)
+    local ok, _, rest = writeSync(handle, table.concat(buffer))
+    -- Only when writes are still queued: try_write can't jump them, so
+    -- this goes behind them and out with the loop's last run
+    if not ok then uv.write(handle, rest) end
+  end
+end
+
 local function console_write(fs, s)
   s = s .. '\n'
-  if uv.guess_handle(uv.fileno(fs))=='tty' then
-    repeat
-      local n, e = uv.try_write(fs, s)
-      if n then
-        s = s:sub(n+1)
-        n = 0
-      else
-        if e:match('^EAGAIN') then
-          n = 0
-        else
-          assert(n, e)
-        end
-      end
-    until n==#s
-  else
-    uv.write(fs, s)
+  if syncWrites or isTTY(fs) then
+    local ok, e, rest = writeSync(fs, s)
+    if ok then return end
+    -- Behind writes still in flight, keep the order
+    if e:match('^EAGAIN') then return uv.write(fs, rest) end
+    error(e)
+  end
+  local buffer = buffers[fs]
+  if not buffer then
+    buffer = {}
+    buffers[fs] = buffer
+    bufferedBytes[fs] = 0
+    if not flusher then
+      flusher = uv.new_prepare()
+      uv.unref(flusher)
+    end
+    uv.prepare_start(flusher, flushAll)
+  end
+  buffer[#buffer + 1] = s
+  local bytes = bufferedBytes[fs] + #s
+  bufferedBytes[fs] = bytes
+  if bytes >= BUFFER_SIZE then
+    flush(fs)
   end
 end
 -- Print replacement that goes through libuv.  This is useful on windows
@@ -381,4 +477,6 @@ return {
   stdout = stdout,
   stderr = stderr,
   strip = strip,
+  flush = flush,
+  flushSync = flushSync,
 }
@@ -18,14 +18,14 @@ limitations under the License.
 
 --[[lit-meta
   name = "luvit/process"
-  version = "2.1.4"
+  version = "2.2.0"
   dependencies = {
     "luvit/hooks@2.0.0",
-    "luvit/timer@2.0.0",
+    "luvit/timer@2.3.0",
     "luvit/utils@2.0.0",
     "luvit/core@2.0.0",
     "luvit/stream@2.0.0",
-    "luvit/pretty-print@2.0.0",
+    "luvit/pretty-print@2.2.0",
   }
   license = "Apache 2"
   homepage = "https://github.com/luvit/luvit/blob/master/deps/process.lua"
@@ -44,10 +44,6 @@ local Readable = require('stream').Readable
 local Writable = require('stream').Writable
 local pp = require('pretty-print')
 
-local function nextTick(...)
-  timer.setImmediate(...)
-end
-
 local function cwd()
   return uv.cwd()
 end
@@ -130,10 +126,16 @@ local function exit(self, code)
   local function onFinish()
     left = left - 1
     if left > 0 then return end
+    -- Both streams are drained, so from here on print() writes block and
+    -- nothing is left queued when the process goes away
+    pp.flushSync()
     self:emit('exit', code)
+    pp.flushSync()
     os.exit(code)
   end
   process.stdout:once('finish', onFinish)
+  -- Finishes once everything print() buffered is written too
+  process.stdout:flush()
   process.stdout:_end()
   process.stderr:once('finish', onFinish)
   process.stderr:_end()
@@ -178,9 +180,17 @@ function UvStreamWritable:initialize(handle)
 end
 
 function UvStreamWritable:_write(data, callback)
+  -- Lines print() buffered for this handle go first
+  pp.flush(self.handle)
   uv.write(self.handle, data, callback)
 end
 
+-- Write out what print() has buffered, callback runs once it's written
+function UvStreamWritable:flush(callback)
+  -- _write sends the buffered lines ahead of the empty chunk
+  self:write("", callback)
+end
+
 local UvStreamReadable = Readable:extend()
 function UvStreamReadable:initialize(handle)
   Readable.initialize(self, { highWaterMark = 0 })
@@ -213,7 +223,7 @@ local function globalProcess()
   local process = Emitter:new()
   process.argv = args
   process.exitCode = 0
-  process.nextTick = nextTick
+  process.nextTick = timer.nextTick
   process.env = lenv
   process.cwd = cwd
   process.kill = kill
@@ -234,6 +244,7 @@ local function globalProcess()
   process.stdout = UvStreamWritable:new(pp.stdout)
   process.stderr = UvStreamWritable:new(pp.stderr)
   hooks:on('process.exit', utils.bind(process.emit, process, 'exit'))
+  hooks:on('process.exit', pp.flushSync)
   hooks:on('process.uncaughtException', utils.bind(process.emit, process, 'uncaughtException'))
   return process
 end
@@ -1,9 +1,9 @@
 return {
   name = "luvit/stream",
-  version = "2.0.3",
+  version = "2.3.0",
   dependencies = {
     "luvit/core@2.0.0",
-    "luvit/utils@2.0.0",
+    "luvit/utils@2.2.0",
   },
   license = "Apache 2",
   homepage = "https://github.com/luvit/luvit/blob/master/deps/stream",
@@ -70,7 +70,7 @@ function onend(self)
   // no more data can be written.
   // But allow more writes to happen in this tick.
   --]]
-  process.nextTick(utils.bind(self._end, self))
+  process.nextTick(self._end, self)
 end
 
 return { Duplex = Duplex }
@@ -38,7 +38,11 @@ function ReadableState:initialize(options, stream)
 
   self.highWaterMark = hwm or defaultHwm
 
-  self.buffer = {}
+  --[[
+  // chunks waiting to be read, kept as a deque: list[head..tail], with
+  // `offset` bytes of list[head] already consumed.
+  --]]
+  self.buffer = { head = 1, tail = 0, offset = 0 }
   self.length = 0
   self.pipes = nil
   self.pipesCount = 0
@@ -109,9 +113,13 @@ local len, readableAddChunk, chunkInvalid, onEofChunk, emitReadable,
   endReadable, fromList, emitReadable_, flow, maybeReadMore_, resume,
   resume_, pipeOnDrain
 
+local isBuffer = utils.isBuffer
+
 function len(buf)
   if type(buf) == 'string' then
     return string.len(buf)
+  elseif isBuffer(buf) then
+    return buf.length
   elseif type(buf) == 'table' then
     return #buf
   else
@@ -119,6 +127,67 @@ function len(buf)
   end
 end
 
+-- string.sub for string and Buffer chunks, Buffers give a view
+local function sub(chunk, i, j)
+  if type(chunk) == 'string' then
+    return string.sub(chunk, i, j)
+  end
+  return chunk:slice(i, j or chunk.length)
+end
+
+-- table.concat of chunks i to j, Buffers are copied into the string
+local function join(list, i, j)
+  for k = i, j do
+    if type(list[k]) ~= 'string' then
+      local parts = {}
+      for m = i, j do
+        parts[#parts + 1] = tostring(list[m])
+      end
+      return table.concat(parts)
+    end
+  end
+  return table.concat(list, '', i, j)
+end
+
+--[[
+// The buffer deque.  Partial reads move buffer.offset forward instead of
+// re-slicing the rest of the head chunk, so read(n) only touches the
+// chunks it returns.
+--]]
+local function bufferCount(buffer)
+  return buffer.tail - buffer.head + 1
+end
+
+local function bufferPush(buffer, chunk)
+  local tail = buffer.tail + 1
+  buffer[tail] = chunk
+  buffer.tail = tail
+end
+
+local function bufferUnshift(buffer, chunk)
+  local head = buffer.head
+  if buffer.offset > 0 then
+    buffer[head] = sub(buffer[head], buffer.offset + 1)
+    buffer.offset = 0
+  end
+  head = head - 1
+  buffer[head] = chunk
+  buffer.head = head
+end
+
+local function bufferShift(buffer)
+  local head = buffer.head
+  local chunk = buffer[head]
+  buffer[head] = nil
+  if head == buffer.tail then
+    buffer.head, buffer.tail = 1, 0
+  else
+    buffer.head = head + 1
+  end
+  buffer.offset = 0
+  return chunk
+end
+
 function Readable:initialize(options)
   self._readableState = ReadableState:new(options, self)
   if type(Stream.initialize) == 'function' then
@@ -181,9 +250,9 @@ function readableAddChunk(stream, state, chunk, addToFront)
           state.length = state.length + len(chunk)
         end
         if addToFront then
-          table.insert(state.buffer, 1, chunk)
+          bufferUnshift(state.buffer, chunk)
         else
-          table.insert(state.buffer,chunk)
+          bufferPush(state.buffer, chunk)
         end
 
         if state.needReadable then
@@ -246,8 +315,9 @@ function howMuchToRead(n, state)
 
   -- n ~= n <==> isnan(n)
   if n ~= n or not n then
-    if state.flowing and len(state.buffer) > 0 then
-      return len(state.buffer[1])
+    local buffer = state.buffer
+    if state.flowing and bufferCount(buffer) > 0 then
+      return len(buffer[buffer.head]) - buffer.offset
     else
       return state.length
     end
@@ -423,6 +493,7 @@ function chunkInvalid(state, chunk)
   local er
   if type(chunk) ~= 'string' and
     chunk and
+    not isBuffer(chunk) and
     not state.objectMode then
     er = Error:new('Invalid non-string/buffer chunk')
   end
@@ -449,9 +520,7 @@ function emitReadable(stream)
   if not state.emittedReadable then
     state.emittedReadable = true
     if state.sync then
-      process.nextTick(function()
-        emitReadable_(stream)
-      end)
+      process.nextTick(emitReadable_, stream)
     else
       emitReadable_(stream)
     end
@@ -475,9 +544,7 @@ end
 function maybeReadMore(stream, state)
   if not state.readingMore then
     state.readingMore = true
-    process.nextTick(function()
-      maybeReadMore_(stream, state)
-    end)
+    process.nextTick(maybeReadMore_, stream, state)
   end
 end
 
@@ -807,9 +874,7 @@ end
 function resume(stream, state)
   if not state.resumeScheduled then
     state.resumeScheduled = true
-    process.nextTick(function()
-      resume_(stream, state)
-    end)
+    process.nextTick(resume_, stream, state)
   end
 end
 
@@ -913,57 +978,61 @@ function fromList(n, state)
   --[[
   // nothing in the list, definitely empty.
   --]]
-  if len(list) == 0 then
+  if bufferCount(list) == 0 then
     return nil
   end
 
   if length == 0 then
     ret = nil
   elseif objectMode then
-    ret = table.remove(list, 1)
+    ret = bufferShift(list)
   elseif not n or n >= length then
-    ret = table.concat(list, '')
-    state.buffer = {}
+    if list.offset > 0 then
+      list[list.head] = sub(list[list.head], list.offset + 1)
+    end
+    ret = join(list, list.head, list.tail)
+    state.buffer = { head = 1, tail = 0, offset = 0 }
   else
     --[[
     // read just some of it.
     --]]
-    if n < len(list[1]) then
+    local first = list[list.head]
+    local offset = list.offset
+    local available = len(first) - offset
+    if n < available then
       --[[
       // just take a part of the first list item.
-      // slice is the same for buffers and strings.
       --]]
-      local buf = list[1]
-
-      ret = string.sub(buf,1,n)
-      list[1] = string.sub(buf,n+1, -1)
-    elseif n == len(list[1]) then
+      ret = sub(first, offset + 1, offset + n)
+      list.offset = offset + n
+    elseif n == available then
       --[[
       // first list is a perfect match
       --]]
-      ret = table.remove(list, 1)
+      bufferShift(list)
+      ret = offset > 0 and sub(first, offset + 1) or first
     else
       --[[
       // complex case.
       // we have enough to cover it, but it spans past the first buffer.
       --]]
-
-      -- for better GC efficiency. (http://www.lua.org/pil/11.6.html)
-      local tmp = {}
-      local c = 0
-      for i=1,len(list),1 do
-        if n - c >= len(list[1]) then
-          -- grab the entire list[1]
-          c = c+ list[1]
-          table.insert(tmp, table.remove(list, 1))
+      bufferShift(list)
+      local parts = { offset > 0 and sub(first, offset + 1) or first }
+      local c = available
+      while c < n do
+        local chunk = list[list.head]
+        local size = len(chunk)
+        if n - c >= size then
+          -- grab the entire chunk
+          parts[#parts + 1] = bufferShift(list)
+          c = c + size
         else
+          parts[#parts + 1] = sub(chunk, 1, n - c)
+          list.offset = n - c
           c = n
-          table.insert(tmp, string.sub(list[1], 1, n-c))
-          list[1] = string.sub(list[1], n+1, -1)
-          break
         end
       end
-      ret = table.concat(tmp)
+      ret = join(parts, 1, #parts)
     end
   end
   return ret
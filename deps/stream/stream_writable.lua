@@ -17,9 +17,36 @@ limitations under the License.
 --]]
 
 local core = require('core')
+local utils = require('utils')
 local Stream = require('./stream_core').Stream
 local Error = core.Error
 
+-- Buffers (deps/buffer.lua) are valid chunks too, and so are lists of
+-- strings and Buffers, which sockets and files write in one go.
+local isBuffer = utils.isBuffer
+
+local function isChunkList(chunk)
+  if type(chunk) ~= 'table' or isBuffer(chunk) then return false end
+  for i = 1, #chunk do
+    local part = chunk[i]
+    if type(part) ~= 'string' and not isBuffer(part) then return false end
+  end
+  return true
+end
+
+local function chunkLength(chunk)
+  if type(chunk) == 'string' then
+    return #chunk
+  elseif isBuffer(chunk) then
+    return chunk.length
+  end
+  local total = 0
+  for i = 1, #chunk do
+    total = total + chunkLength(chunk[i])
+  end
+  return total
+end
+
 local onwrite, writeAfterEnd, validChunk, writeOrBuffer, clearBuffer,
   decodeChunk, doWrite, onwriteError, onwriteStateUpdate, needFinish,
   afterWrite, finishMaybe, onwriteDrain, endWritable, prefinish
@@ -189,9 +216,7 @@ function writeAfterEnd(stream, state, cb)
   // TODO: defer error events consistently everywhere, not just the cb
   --]]
   stream:emit('error', er)
-  process.nextTick(function()
-    cb(er)
-  end)
+  process.nextTick(cb, er)
 end
 
 --[[
@@ -203,12 +228,11 @@ end
 --]]
 function validChunk(stream, state, chunk, cb)
   local valid = true
-  if chunk ~= nil and type(chunk) ~= 'string' and not state.objectMode then
+  if chunk ~= nil and type(chunk) ~= 'string' and not isBuffer(chunk) and
+      not isChunkList(chunk) and not state.objectMode then
     local er = Error:new('Invalid non-string/buffer chunk')
     stream:emit('error', er)
-    process.nextTick(function()
-      cb(er)
-    end)
+    process.nextTick(cb, er)
     valid = false
   end
   return valid
@@ -281,7 +305,7 @@ function writeOrBuffer(stream, state, chunk, cb)
   if state.objectMode then
     len = 1
   else
-    len = string.len(chunk)
+    len = chunkLength(chunk)
   end
 
   state.length = state.length + len
@@ -361,9 +385,7 @@ function onwrite(stream, er)
     end
 
     if sync then
-      process.nextTick(function()
-        afterWrite(stream, state, finished, cb)
-      end)
+      process.nextTick(afterWrite, stream, state, finished, cb)
     else
       afterWrite(stream, state, finished, cb)
     end
@@ -436,7 +458,7 @@ function clearBuffer(stream, state)
       if state.objectMode then
         len = 1
       else
-        len =string.len(chunk)
+        len = chunkLength(chunk)
       end
 
       doWrite(stream, state, false, len, chunk, cb)
@@ -17,7 +17,7 @@ limitations under the License.
 --]]
 --[[lit-meta
   name = "luvit/timer"
-  version = "2.0.2"
+  version = "2.3.0"
   dependencies = {
     "luvit/core@2.0.0",
     "luvit/utils@2.1.0",
@@ -33,6 +33,7 @@ local Object = require('core').Object
 local bind = require('utils').bind
 local assertResume = require('utils').assertResume
 local unpack = unpack or table.unpack ---@diagnostic disable-line: deprecated
+local date = require('os').date
 
 -------------------------------------------------------------------------------
 
@@ -117,50 +118,216 @@ local function clearInterval(timer)
 end
 
 
+-- Deferred calls are stored flat as fn, argc, args... in a queue table so
+-- queueing one doesn't allocate a closure.  Each queue is double buffered:
+-- a batch is run from one table while new calls go into the other, and
+-- both tables are reused forever.
+
+local function newQueue()
+  return { length = 0, count = 0 }
+end
+
+local function push(queue, fn, ...)
+  local n = select('#', ...)
+  local i = queue.length
+  queue[i + 1] = fn
+  queue[i + 2] = n
+  for j = 1, n do
+    queue[i + 2 + j] = (select(j, ...))
+  end
+  queue.length = i + 2 + n
+  queue.count = queue.count + 1
+end
+
+local function clear(queue, first, last, ...)
+  for i = first, last do
+    queue[i] = nil
+  end
+  return ...
+end
+
+-- Run a detached batch, calling afterEach between the calls
+local function runQueue(queue, afterEach)
+  local length = queue.length
+  queue.length, queue.count = 0, 0
+  local i = 1
+  while i <= length do
+    local fn, n = queue[i], queue[i + 1]
+    local last = i + 1 + n
+    fn(clear(queue, i, last, unpack(queue, i + 2, last)))
+    if afterEach then afterEach() end
+    i = last + 1
+  end
+end
+
+local immediates, immediatesBatch = newQueue(), newQueue()
+local ticks, ticksBatch = newQueue(), newQueue()
+
+-- nextTick callbacks run until there are none left, including the ones they
+-- queue themselves.
+local function runTicks()
+  while ticks.count > 0 do
+    local queue = ticks
+    ticks, ticksBatch = ticksBatch, queue
+    runQueue(queue)
+  end
+end
+
 local checker = uv.new_check()
+local preparer = uv.new_prepare()
 local idler = uv.new_idle()
-local immediateQueue = {}
+local hooked = false
 
-local function onCheck()
-  local queue = immediateQueue
-  immediateQueue = {}
-  for i = 1, #queue do
-    queue[i]()
-  end
-  -- If the queue is still empty, we processed them all
-  -- Turn the check hooks back off.
-  if #immediateQueue == 0 then
+local function unhookIfDone()
+  if immediates.count == 0 and ticks.count == 0 then
+    hooked = false
     uv.check_stop(checker)
+    uv.prepare_stop(preparer)
     uv.idle_stop(idler)
   end
 end
 
+-- Ticks queued by timers run before the loop polls for I/O
+local function onPrepare()
+  runTicks()
+  unhookIfDone()
+end
+
+-- Ticks queued by I/O callbacks run first, then the immediates queued so
+-- far, with the ticks each of those queues.
+local function onCheck()
+  runTicks()
+  local queue = immediates
+  immediates, immediatesBatch = immediatesBatch, queue
+  runQueue(queue, runTicks)
+  unhookIfDone()
+end
+
+-- The idle hook only keeps the loop from blocking in poll while there is
+-- work queued.
+local function hook()
+  hooked = true
+  uv.check_start(checker, onCheck)
+  uv.prepare_start(preparer, onPrepare)
+  uv.idle_start(idler, runTicks)
+end
+
 local function setImmediate(callback, ...)
+  if not hooked then hook() end
+  push(immediates, callback, ...)
+end
 
-  -- If the queue was empty, the check hooks were disabled.
-  -- Turn them back on.
-  if #immediateQueue == 0 then
-    uv.check_start(checker, onCheck)
-    uv.idle_start(idler, onCheck)
-  end
+local function nextTick(callback, ...)
+  if not hooked then hook() end
+  push(ticks, callback, ...)
+end
 
-  immediateQueue[#immediateQueue + 1] = bind(callback, ...)
+-- Number of setImmediate and nextTick callbacks waiting to run
+local function queueDepth()
+  return immediates.count, ticks.count
 end
 
 ------------------------------------------------------------------------------
 
-local lists = {}
+-- The current time formatted for HTTP Date headers.  It's formatted once a
+-- second by a single unref'd timer instead of on every call.
+local httpDateString
+local dateTicker
+
+local function updateHttpDate()
+  httpDateString = date("!%a, %d %b %Y %H:%M:%S GMT")
+end
+
+local function httpDate()
+  if not dateTicker then
+    updateHttpDate()
+    -- Line the ticks up with the start of the next second when possible.
+    local delay = 1000
+    if uv.gettimeofday then
+      local _, usec = uv.gettimeofday()
+      delay = 1000 - math.floor(usec / 1000)
+    end
+    dateTicker = uv.new_timer()
+    uv.timer_start(dateTicker, delay, 1000, updateHttpDate)
+    uv.unref(dateTicker)
+  end
+  return httpDateString
+end
+
+------------------------------------------------------------------------------
+
+-- Idle timeouts (enroll/active/unenroll) live in a hashed timer wheel driven
+-- by a single uv timer.  An item is linked into the slot of the tick it
+-- expires on; items more than a turn away just stay in their slot until
+-- their round comes up.  That keeps active and unenroll O(1) no matter how
+-- many different timeout values are in use, and active on a linked item is
+-- a single timestamp store.
+
+local WHEEL_SIZE = 4096 -- slots, about 40 seconds per turn
+local TICK = 10 -- milliseconds per slot
+
+local floor, ceil = math.floor, math.ceil
+local now = uv.now
+
+-- While the wheel has items the loop time is read once per loop iteration
+-- and cached.  The cache is dropped right before the loop polls and again
+-- once the I/O callbacks ran, so the reads after each poll see fresh time.
+local loopNow
+local clockPrepare, clockCheck
+local clockRunning = false
+
+local function forgetTime()
+  loopNow = nil
+end
+
+local function loopTime()
+  local time = loopNow
+  if not time then
+    time = now()
+    if clockRunning then loopNow = time end
+  end
+  return time
+end
+
+local function startClock()
+  if not clockPrepare then
+    clockPrepare = uv.new_prepare()
+    clockCheck = uv.new_check()
+    uv.unref(clockPrepare)
+    uv.unref(clockCheck)
+  end
+  clockRunning = true
+  uv.prepare_start(clockPrepare, forgetTime)
+  uv.check_start(clockCheck, forgetTime)
+end
+
+local function stopClock()
+  clockRunning = false
+  loopNow = nil
+  uv.prepare_stop(clockPrepare)
+  uv.check_stop(clockCheck)
+end
+
+local GROUP_SIZE = 64 -- slots per occupancy count
+
+local wheel = {} -- slot lists, created on first use
+local wheelCount = 0 -- items in the wheel
+local groupCounts = {} -- items linked in each group of GROUP_SIZE slots
+for group = 0, WHEEL_SIZE / GROUP_SIZE - 1 do
+  groupCounts[group] = 0
+end
+local wheelTick = 0 -- first tick not processed yet
+local wheelTimer
+local scheduledTick -- tick the wheel timer fires on, nil when stopped
+local ticking = false
 
 local function init(list)
   list._idleNext = list
   list._idlePrev = list
 end
 
-local function peek(list)
-  if list._idlePrev == list then
-    return nil
-  end
-  return list._idlePrev
+local function isEmpty(list)
+  return list._idleNext == list
 end
 
 local function remove(item)
@@ -184,69 +351,144 @@ local function append(list, item)
   list._idleNext = item
 end
 
-local function isEmpty(list)
-  return list._idleNext == list
+-- Move the item into the slot of tick, keeping the group counts in step
+local function link(item, tick)
+  local slot = tick % WHEEL_SIZE
+  local old = item._idleSlot
+  if old then
+    old = floor(old / GROUP_SIZE)
+    groupCounts[old] = groupCounts[old] - 1
+  end
+  local group = floor(slot / GROUP_SIZE)
+  groupCounts[group] = groupCounts[group] + 1
+  item._idleSlot = slot
+  local list = wheel[slot]
+  if not list then
+    list = {}
+    init(list)
+    wheel[slot] = list
+  end
+  append(list, item)
 end
 
-local expiration
-expiration = function(timer, msecs)
-  return function()
-    local now = Timer.now()
-    while peek(timer) do
-      local elem = peek(timer)
-      local diff = now - elem._idleStart;
-      if ((diff + 1) < msecs) == true then
-        timer:start(msecs - diff, 0, expiration(timer, msecs))
-        return
-      else
-        remove(elem)
-        if elem.emit then
-          elem:emit('timeout')
-        end
-      end
+-- The first tick from wheelTick on whose slot holds items.  Groups with no
+-- items are skipped whole, so this looks at no more than the group counts
+-- and the slots of two groups.
+local function nextOccupied()
+  local tick = wheelTick
+  local last = wheelTick + WHEEL_SIZE
+  while tick < last do
+    local slot = tick % WHEEL_SIZE
+    if groupCounts[floor(slot / GROUP_SIZE)] == 0 then
+      tick = tick + GROUP_SIZE - slot % GROUP_SIZE
+    else
+      local list = wheel[slot]
+      if list and not isEmpty(list) then return tick end
+      tick = tick + 1
     end
+  end
+end
 
-    -- Remove the timer if it wasn't already
-    -- removed by unenroll
-    local list = lists[msecs]
-    if list and isEmpty(list) then
-      list:stop()
-      list:close()
-      lists[msecs] = nil
-    end
+local onWheelTimer
+
+local function schedule(tick)
+  if not wheelTimer then
+    wheelTimer = uv.new_timer()
   end
+  scheduledTick = tick
+  uv.timer_start(wheelTimer, math.max(tick * TICK - loopTime(), 0), 0, onWheelTimer)
 end
 
+local function unschedule()
+  if scheduledTick then
+    uv.timer_stop(wheelTimer)
+    scheduledTick = nil
+  end
+end
+
+-- Take the item out of the wheel
+local function unlink(item)
+  local slot = item._idleSlot
+  if slot then
+    item._idleSlot = nil
+    local group = floor(slot / GROUP_SIZE)
+    groupCounts[group] = groupCounts[group] - 1
+  end
+  if item._idleExpiry then
+    item._idleExpiry = nil
+    wheelCount = wheelCount - 1
+    if wheelCount == 0 then
+      stopClock()
+      if not ticking then unschedule() end
+    end
+  end
+  remove(item)
+end
 
 local function _insert(item, msecs)
-  item._idleStart = Timer.now()
+  local time = loopTime()
+  item._idleStart = time
   item._idleTimeout = msecs
 
   if msecs < 0 then return end
 
-  local list
+  if not item._idleExpiry then
+    if wheelCount == 0 then
+      startClock()
+      if not ticking then wheelTick = floor(time / TICK) end
+    end
+    wheelCount = wheelCount + 1
+  end
 
-  if lists[msecs] then
-    list = lists[msecs]
-  else
-    list = Timer:new()
-    init(list)
-    list:start(msecs, 0, expiration(list, msecs))
-    lists[msecs] = list
+  local expiry = ceil((time + msecs) / TICK)
+  item._idleExpiry = expiry
+  -- Never link into a slot that was already processed this turn
+  if expiry < wheelTick then expiry = wheelTick end
+  link(item, expiry)
+
+  if not ticking and (not scheduledTick or expiry < scheduledTick) then
+    schedule(expiry)
   end
+end
 
-  append(list, item)
+function onWheelTimer()
+  scheduledTick = nil
+  ticking = true
+  loopNow = nil
+  local current = floor(loopTime() / TICK)
+  for tick = wheelTick, current do
+    wheelTick = tick + 1
+    local slot = tick % WHEEL_SIZE
+    local pending = wheel[slot]
+    if pending and not isEmpty(pending) then
+      -- Detach the slot so timeout handlers can re-arm items freely
+      wheel[slot] = nil
+      while not isEmpty(pending) do
+        local item = pending._idlePrev
+        -- active() only moves _idleStart, so work out the real expiry here
+        local expiry = ceil((item._idleStart + item._idleTimeout) / TICK)
+        if expiry <= current then
+          unlink(item)
+          if item.emit then
+            item:emit('timeout')
+          end
+        else
+          -- Active since it was linked, or due on a later turn
+          item._idleExpiry = expiry
+          link(item, expiry)
+        end
+      end
+    end
+  end
+  ticking = false
+
+  if wheelCount == 0 then return end
+  local tick = nextOccupied()
+  if tick then schedule(tick) end
 end
 
 local function unenroll(item)
-  remove(item)
-  local list = lists[item._idleTimeout]
-  if list and isEmpty(list) then
-    -- empty list
-    list:stop()
-    list:close()
-    lists[item._idleTimeout] = nil
-  end
+  unlink(item)
   item._idleTimeout = -1
 end
 
@@ -262,14 +504,13 @@ end
 -- call this whenever the item is active (not idle)
 local function active(item)
   local msecs = item._idleTimeout
-  if msecs and msecs >= 0 then
-    local list = lists[msecs]
-    if not list or isEmpty(list) then
-      _insert(item, msecs)
-    else
-      item._idleStart = Timer.now()
-      append(lists[msecs], item)
-    end
+  if not msecs or msecs < 0 then return end
+  if item._idleExpiry then
+    -- Already in the wheel: just note the time, the item is moved to its new
+    -- slot when the old one comes up.
+    item._idleStart = loopNow or loopTime()
+  else
+    _insert(item, msecs)
   end
 end
 
@@ -281,6 +522,9 @@ return {
   clearTimeout = clearInterval,
   clearTimer = clearInterval, -- Luvit 1.x compatibility
   setImmediate = setImmediate,
+  nextTick = nextTick,
+  queueDepth = queueDepth,
+  httpDate = httpDate,
   unenroll = unenroll,
   enroll = enroll,
   active = active,
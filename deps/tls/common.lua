@@ -191,6 +191,8 @@ function TLSSocket:initialize(socket, options)
   end
 
   self:once('end', function()
+    -- Same as net.Socket, a half open socket is shut down by its owner
+    if self.allowHalfOpen then return end
     self:destroy()
   end)
 
@@ -360,18 +362,29 @@ function TLSSocket:flush(callback)
     chunks[i] = self.out:read()
   end
   if i>0 then
-    chunks = table.concat(chunks)
+    -- uv.write takes the records as they are, in one writev
     net.Socket._write(self, chunks, callback)
+  elseif callback then
+    -- Nothing to send, e.g. after an empty write
+    callback()
   end
 end
 
+-- ssl:write takes one string, lists of strings and Buffers are joined
+local function sslData(data)
+  data = utils.toWriteData(data)
+  if type(data) == 'table' then return table.concat(data) end
+  return data
+end
+
 function TLSSocket:_write(data, callback)
   local ret, err
   if (not self.ssl or self.destroyed or self._shutdown or not self._connected)
   then
     return
   end
-  if data then
+  data = data and sslData(data)
+  if data and #data > 0 then
     ret, err = self.ssl:write(data)
     if ret == nil then
       return self:destroy(err)
@@ -380,6 +393,20 @@ function TLSSocket:_write(data, callback)
   self:flush(callback)
 end
 
+function TLSSocket:_writev(requests, callback)
+  if (not self.ssl or self.destroyed or self._shutdown or not self._connected)
+  then
+    return
+  end
+  for i = 1, #requests do
+    local ret, err = self.ssl:write(sslData(requests[i].chunk))
+    if ret == nil then
+      return self:destroy(err)
+    end
+  end
+  self:flush(callback)
+end
+
 function TLSSocket:_read(n)
   local onData, handshake, incoming
 
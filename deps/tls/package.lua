@@ -1,11 +1,11 @@
 return {
   name = "luvit/tls",
-  version = "2.3.2",
+  version = "2.3.4",
   dependencies = {
     "luvit/core@2.0.0",
     "luvit/net@2.0.0",
     "luvit/timer@2.0.0",
-    "luvit/utils@2.0.0",
+    "luvit/utils@2.2.0",
   },
   license = "Apache 2",
   homepage = "https://github.com/luvit/luvit/blob/master/deps/tls",
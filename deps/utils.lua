@@ -18,7 +18,7 @@ limitations under the License.
 
 --[[lit-meta
   name = "luvit/utils"
-  version = "2.1.0"
+  version = "2.2.0"
   dependencies = {
     "luvit/pretty-print@2.0.0",
   }
@@ -110,8 +110,45 @@ local function adapt(c, fn, ...)
   end
 end
 
+-- Buffers from deps/buffer.lua, checked by shape to keep utils free of ffi
+local function isBuffer(value)
+  return type(value) == 'table' and value.ctype ~= nil and
+    type(value.length) == 'number'
+end
+
+local function appendWriteData(list, data)
+  if type(data) ~= 'table' then
+    list[#list + 1] = data
+  elseif isBuffer(data) then
+    list[#list + 1] = tostring(data)
+  else
+    for i = 1, #data do
+      appendWriteData(list, data[i])
+    end
+  end
+  return list
+end
+
+-- luv's write calls only take a string or a flat list of strings, so a
+-- Buffer (or Buffers in a list) is copied out once, right at the uv call.
+-- Nested lists, as a writev of list chunks produces, are flattened.  TCP
+-- and pipe sockets write Buffers without this copy (net.Socket:_write), it
+-- is the fallback for TLS, Windows, files and datagrams.
+local function toWriteData(data)
+  if type(data) ~= 'table' then return data end
+  if isBuffer(data) then return tostring(data) end
+  for i = 1, #data do
+    if type(data[i]) == 'table' then
+      return appendWriteData({}, data)
+    end
+  end
+  return data
+end
+
 utils.bind = bind
 utils.noop = noop
+utils.isBuffer = isBuffer
+utils.toWriteData = toWriteData
 utils.adapt = adapt
 utils.assertResume = assertResume
 
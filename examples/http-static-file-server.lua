@@ -204,31 +204,22 @@ function Response:error(reason)
 end
 
 local root = module.dir
+local cache = fs.FileCache:new()
 http.createServer(function(req, res)
   req.uri = url.parse(req.url)
   local path = root .. req.uri.pathname
   p('path',path)
-  fs.stat(path, function (err, stat)
-    if err then
-      if err.code == "ENOENT" then
-        return res:notFound(err.message .. "\n")
-      end
-      return res:error((err.message or tostring(err)) .. "\n")
+  res:setHeader("Content-Type", getType(path))
+  res:sendFile(path, {
+    cacheControl = "max-age=60",
+    cache = cache,
+  }, function (err)
+    if not err or res.headersSent then return end
+    if err:match("^ENOENT") or err:match("^EISDIR") then
+      return res:notFound(err .. "\n")
     end
-    p(stat)
-    if stat.type ~= 'file'    then
-      return res:notFound("Requested url is not a file\n")
-    end
-
-    res:writeHead(200, {
-      ["Content-Type"] = getType(path),
-      ["Content-Length"] = stat.size
-    })
-
-    fs.createReadStream(path):pipe(res)
-
+    res:error(err .. "\n")
   end)
-
 end):listen(8080)
 
 print("Http static file server listening at http://localhost:8080/")
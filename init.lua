@@ -68,6 +68,7 @@ return function (main, ...)
     uv.run()
   else
     _G.process.exitCode = -1
+    require('pretty-print').flushSync()
     require('pretty-print').stderr:write("Uncaught exception:\n" .. err .. "\n")
   end
 
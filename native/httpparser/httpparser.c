@@ -0,0 +1,449 @@
+/*
+ *  Copyright 2015 The Luvit Authors. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS-IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ */
+
+/*
+ * Incremental parser for HTTP/1.x request and status lines plus headers.
+ *
+ * The parser is fed the same growing buffer over and over (the previous
+ * buffer with more data appended) and only scans the bytes it has not seen
+ * yet, so a head that arrives in many small pieces is parsed in linear time.
+ * The caller says whether a call continues the previous one, the parser
+ * never guesses that from the data.
+ * It follows the same rules as the pure lua parser in http-codec.lua.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "httpparser.h"
+
+/* Refuse heads this long that still haven't been terminated */
+#define MAX_HEAD (8 * 1024)
+
+enum {
+  S_FIRST,              /* method or HTTP/x.y */
+  S_CODE,               /* status code */
+  S_REASON,             /* status reason */
+  S_PATH,               /* request path */
+  S_VERSION,            /* request HTTP/x.y */
+  S_LINE_CR,            /* start line saw \r and needs \n */
+  S_LINE_START,         /* beginning of a header line */
+  S_LINE_START_CR,      /* blank line saw \r */
+  S_KEY,
+  S_VALUE_WS,           /* spaces between : and the value */
+  S_VALUE,
+  S_VALUE_CR,
+  S_SKIP,               /* malformed header, look for the end of head only */
+  S_SKIP_LINE_START,
+  S_SKIP_LINE_START_CR,
+  S_DONE,
+  S_ERROR,
+  S_NOMEM
+};
+
+typedef struct {
+  size_t start;
+  size_t end;
+} Span;
+
+typedef struct {
+  int state;
+  int response;
+  size_t pos;       /* next byte of the buffered chunk to scan */
+  size_t mark;      /* start of the token being scanned */
+  Span line[3];     /* method, path, version or version, code, reason */
+  Span key;
+  Span value;
+  Span* fields;     /* key, value, key, value, ... */
+  size_t count;
+  size_t size;
+} HttpParser;
+
+static void parser_clear(HttpParser* parser) {
+  parser->state = S_FIRST;
+  parser->response = 0;
+  parser->pos = 0;
+  parser->mark = 0;
+  parser->count = 0;
+}
+
+static int is_version(const char* chunk, Span span) {
+  const char* s = chunk + span.start;
+  return span.end - span.start == 8 &&
+    memcmp(s, "HTTP/", 5) == 0 &&
+    s[5] >= '0' && s[5] <= '9' &&
+    s[6] == '.' &&
+    s[7] >= '0' && s[7] <= '9';
+}
+
+static int is_method(const char* chunk, Span span) {
+  size_t i;
+  if (span.end == span.start) return 0;
+  for (i = span.start; i < span.end; i++) {
+    if (chunk[i] < 'A' || chunk[i] > 'Z') return 0;
+  }
+  return 1;
+}
+
+static int span_equals(const char* chunk, Span span, const char* lower) {
+  size_t len = strlen(lower);
+  size_t i;
+  if (span.end - span.start != len) return 0;
+  for (i = 0; i < len; i++) {
+    char c = chunk[span.start + i];
+    if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    if (c != lower[i]) return 0;
+  }
+  return 1;
+}
+
+static int push_field(HttpParser* parser) {
+  if (parser->count + 2 > parser->size) {
+    size_t size = parser->size ? parser->size * 2 : 32;
+    Span* fields = (Span*)realloc(parser->fields, size * sizeof(Span));
+    if (!fields) return 0;
+    parser->fields = fields;
+    parser->size = size;
+  }
+  parser->fields[parser->count++] = parser->key;
+  parser->fields[parser->count++] = parser->value;
+  return 1;
+}
+
+/* Advance the state machine by one byte */
+static int parser_step(HttpParser* parser, const char* chunk, char c) {
+  size_t pos = parser->pos;
+  switch (parser->state) {
+    case S_FIRST:
+      if (c == ' ') {
+        parser->line[0].start = parser->mark;
+        parser->line[0].end = pos;
+        if (is_version(chunk, parser->line[0])) {
+          parser->response = 1;
+          parser->state = S_CODE;
+        } else if (is_method(chunk, parser->line[0])) {
+          parser->state = S_PATH;
+        } else {
+          return S_ERROR;
+        }
+        parser->mark = pos + 1;
+      } else if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                   c == '/' || c == '.')) {
+        return S_ERROR;
+      }
+      break;
+
+    case S_CODE:
+      if (c == ' ' && pos > parser->mark) {
+        parser->line[1].start = parser->mark;
+        parser->line[1].end = pos;
+        parser->mark = pos + 1;
+        parser->state = S_REASON;
+      } else if (c < '0' || c > '9') {
+        return S_ERROR;
+      }
+      break;
+
+    case S_REASON:
+      if (c == '\r' || c == '\n') {
+        parser->line[2].start = parser->mark;
+        parser->line[2].end = pos;
+        parser->state = c == '\r' ? S_LINE_CR : S_LINE_START;
+      }
+      break;
+
+    case S_PATH:
+      if (c == ' ') {
+        if (pos == parser->mark) return S_ERROR;
+        parser->line[1].start = parser->mark;
+        parser->line[1].end = pos;
+        parser->mark = pos + 1;
+        parser->state = S_VERSION;
+      } else if (c == '\r' || c == '\n') {
+        return S_ERROR;
+      }
+      break;
+
+    case S_VERSION:
+      if (c == '\r' || c == '\n') {
+        parser->line[2].start = parser->mark;
+        parser->line[2].end = pos;
+        if (!is_version(chunk, parser->line[2])) return S_ERROR;
+        parser->state = c == '\r' ? S_LINE_CR : S_LINE_START;
+      } else if (pos - parser->mark >= 8) {
+        return S_ERROR;
+      }
+      break;
+
+    case S_LINE_CR:
+      if (c != '\n') return S_ERROR;
+      parser->state = S_LINE_START;
+      break;
+
+    case S_LINE_START:
+      if (c == '\n') {
+        parser->state = S_DONE;
+      } else if (c == '\r') {
+        parser->state = S_LINE_START_CR;
+      } else if (c == ':') {
+        parser->state = S_SKIP;
+      } else {
+        parser->mark = pos;
+        parser->state = S_KEY;
+      }
+      break;
+
+    case S_LINE_START_CR:
+      parser->state = c == '\n' ? S_DONE : S_SKIP;
+      break;
+
+    case S_KEY:
+      if (c == ':') {
+        parser->key.start = parser->mark;
+        parser->key.end = pos;
+        parser->state = S_VALUE_WS;
+      } else if (c == '\r') {
+        parser->state = S_SKIP;
+      } else if (c == '\n') {
+        parser->state = S_SKIP_LINE_START;
+      }
+      break;
+
+    case S_VALUE_WS:
+      if (c == ' ') break;
+      parser->mark = pos;
+      parser->state = S_VALUE;
+      /* fall through */
+
+    case S_VALUE:
+      if (c == '\r' || c == '\n') {
+        parser->value.start = parser->mark;
+        parser->value.end = pos;
+        if (c == '\r') {
+          parser->state = S_VALUE_CR;
+        } else {
+          if (!push_field(parser)) return S_NOMEM;
+          parser->state = S_LINE_START;
+        }
+      }
+      break;
+
+    case S_VALUE_CR:
+      if (c == '\n') {
+        if (!push_field(parser)) return S_NOMEM;
+        parser->state = S_LINE_START;
+      } else {
+        parser->state = S_SKIP;
+      }
+      break;
+
+    case S_SKIP:
+      if (c == '\n') parser->state = S_SKIP_LINE_START;
+      break;
+
+    case S_SKIP_LINE_START:
+      if (c == '\n') {
+        parser->state = S_DONE;
+      } else {
+        parser->state = c == '\r' ? S_SKIP_LINE_START_CR : S_SKIP;
+      }
+      break;
+
+    case S_SKIP_LINE_START_CR:
+      parser->state = c == '\n' ? S_DONE : S_SKIP;
+      break;
+  }
+  return parser->state;
+}
+
+static void push_span(lua_State* L, const char* chunk, Span span) {
+  lua_pushlstring(L, chunk + span.start, span.end - span.start);
+}
+
+/* Builds the head table and returns head, length, contentLength, chunked */
+static int push_head(lua_State* L, HttpParser* parser, const char* chunk) {
+  Span version;
+  size_t i;
+  int keepAlive, chunked = 0, hasLength = 0;
+  double contentLength = 0;
+
+  lua_createtable(L, (int)(parser->count / 2), 4);
+
+  if (parser->response) {
+    version = parser->line[0];
+    push_span(L, chunk, parser->line[1]);
+    lua_pushnumber(L, lua_tonumber(L, -1));
+    lua_setfield(L, -3, "code");
+    lua_pop(L, 1);
+    push_span(L, chunk, parser->line[2]);
+    lua_setfield(L, -2, "reason");
+  } else {
+    version = parser->line[2];
+    push_span(L, chunk, parser->line[0]);
+    lua_setfield(L, -2, "method");
+    push_span(L, chunk, parser->line[1]);
+    lua_setfield(L, -2, "path");
+  }
+
+  /* "HTTP/1.1" -> 1.1 */
+  lua_pushlstring(L, chunk + version.start + 5, 3);
+  lua_pushnumber(L, lua_tonumber(L, -1));
+  keepAlive = lua_tonumber(L, -1) > 1.0;
+  lua_setfield(L, -3, "version");
+  lua_pop(L, 1);
+
+  for (i = 0; i < parser->count; i += 2) {
+    Span key = parser->fields[i];
+    Span value = parser->fields[i + 1];
+
+    /* Inspect a few headers and remember the values */
+    if (span_equals(chunk, key, "content-length")) {
+      push_span(L, chunk, value);
+      hasLength = lua_isnumber(L, -1);
+      contentLength = hasLength ? lua_tonumber(L, -1) : 0;
+      lua_pop(L, 1);
+    } else if (span_equals(chunk, key, "transfer-encoding")) {
+      chunked = span_equals(chunk, value, "chunked");
+    } else if (span_equals(chunk, key, "connection")) {
+      keepAlive = span_equals(chunk, value, "keep-alive");
+    }
+
+    lua_createtable(L, 2, 0);
+    push_span(L, chunk, key);
+    lua_rawseti(L, -2, 1);
+    push_span(L, chunk, value);
+    lua_rawseti(L, -2, 2);
+    lua_rawseti(L, -2, (int)(i / 2 + 1));
+  }
+
+  lua_pushboolean(L, keepAlive);
+  lua_setfield(L, -2, "keepAlive");
+
+  lua_pushinteger(L, (lua_Integer)parser->pos);
+  if (hasLength) {
+    lua_pushnumber(L, contentLength);
+  } else {
+    lua_pushnil(L);
+  }
+  lua_pushboolean(L, chunked);
+  return 4;
+}
+
+/* Constructor function for parser instances */
+static int new_parser(lua_State* L) {
+  HttpParser* parser = (HttpParser*)lua_newuserdata(L, sizeof(HttpParser));
+  parser->fields = NULL;
+  parser->size = 0;
+  parser_clear(parser);
+
+  luaL_getmetatable(L, "httpparser");
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
+
+/*
+ * parser:parse(chunk, [index], [resume]) -> head, length, contentLength, chunked
+ *
+ * Parses the head starting at index and returns its length in bytes.
+ * Returns nothing when the head is not complete yet.  Pass resume = true
+ * on the next call, with the same data and more appended (it may start at
+ * a different index of a different string), and scanning resumes where it
+ * stopped.  Without resume a new head is parsed from the start.
+ */
+static int parser_parse(lua_State* L) {
+  HttpParser* parser = (HttpParser*)luaL_checkudata(L, 1, "httpparser");
+  size_t len;
+  const char* chunk = luaL_checklstring(L, 2, &len);
+  size_t index = (size_t)luaL_optinteger(L, 3, 1);
+  int resume = lua_toboolean(L, 4);
+
+  luaL_argcheck(L, index >= 1 && index <= len + 1, 3, "index out of range");
+  chunk += index - 1;
+  len -= index - 1;
+
+  if (!resume) {
+    parser_clear(parser);
+  } else if (len < parser->pos) {
+    parser_clear(parser);
+    return luaL_argerror(L, 2, "shorter than the data already scanned");
+  }
+
+  while (parser->pos < len) {
+    int state = parser_step(parser, chunk, chunk[parser->pos]);
+    parser->pos++;
+    if (state == S_DONE) {
+      int ret = push_head(L, parser, chunk);
+      parser_clear(parser);
+      return ret;
+    }
+    if (state == S_ERROR) {
+      parser_clear(parser);
+      return luaL_error(L, "expected HTTP data");
+    }
+    if (state == S_NOMEM) {
+      parser_clear(parser);
+      return luaL_error(L, "not enough memory");
+    }
+  }
+
+  /* But protect against evil clients by refusing heads over 8K long. */
+  if (len >= MAX_HEAD) {
+    parser_clear(parser);
+    return luaL_error(L, "entity too large");
+  }
+  return 0;
+}
+
+static int parser_reset(lua_State* L) {
+  HttpParser* parser = (HttpParser*)luaL_checkudata(L, 1, "httpparser");
+  parser_clear(parser);
+  return 0;
+}
+
+static int parser_gc(lua_State* L) {
+  HttpParser* parser = (HttpParser*)luaL_checkudata(L, 1, "httpparser");
+  free(parser->fields);
+  parser->fields = NULL;
+  parser->size = 0;
+  return 0;
+}
+
+static const luaL_reg httpparser_f[] = {
+  {"new", new_parser},
+  {NULL, NULL}
+};
+
+static const luaL_reg httpparser_m[] = {
+  {"parse", parser_parse},
+  {"reset", parser_reset},
+  {"__gc", parser_gc},
+  {NULL, NULL}
+};
+
+LUALIB_API int luaopen_httpparser (lua_State *L) {
+
+  /* Create a metatable for the parser type */
+  luaL_newmetatable(L, "httpparser");
+  luaL_register(L, NULL, httpparser_m);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_newtable (L);
+  luaL_register(L, NULL, httpparser_f);
+  return 1;
+}
@@ -0,0 +1,9 @@
+#ifndef LIB_HTTPPARSER
+#define LIB_HTTPPARSER
+
+#include "lua.h"
+#include "lauxlib.h"
+
+LUALIB_API int luaopen_httpparser (lua_State *L);
+
+#endif
@@ -22,6 +22,7 @@ return {
   dependencies = {
     "luvit/buffer@2.0.0",
     "luvit/childprocess@2.1.2",
+    "luvit/cluster@2.0.0",
     "luvit/codec@2.0.0",
     "luvit/core@2.0.3",
     "luvit/dgram@2.0.0",
@@ -34,6 +35,7 @@ return {
     "luvit/http-header@1.0.0",
     "luvit/https@2.0.0",
     "luvit/json@2.5.1",
+    "luvit/log@2.0.0",
     "luvit/los@2.0.0",
     "luvit/net@2.0.3",
     "luvit/path@2.0.1",
@@ -57,6 +59,7 @@ return {
     "!examples",
     "!tests",
     "!bench",
+    "!native",
     "!lit-*",
   }
 }
@@ -0,0 +1,7 @@
+-- Allocates an empty pooled buffer before any slab exists
+local buffer = require('buffer')
+local empty = buffer.alloc(0)
+assert(empty.length == 0)
+assert(buffer.allocUnsafe(0).length == 0)
+assert(buffer.alloc(16).length == 16)
+process:exit(0)
@@ -0,0 +1,21 @@
+-- Worker for test-cluster: serves its id on a shared reusePort listener and
+-- reports to the test's control port once it listens
+local cluster = require('cluster')
+local net = require('net')
+
+local PORT, CONTROL_PORT = 10110, 10111
+
+cluster.run(function(id)
+  net.createServer(function(client)
+    client:write(tostring(id), function()
+      client:shutdown()
+    end)
+  end):listen({ port = PORT, host = '127.0.0.1', reusePort = true }, function()
+    local control
+    control = net.createConnection(CONTROL_PORT, '127.0.0.1', function()
+      control:write(tostring(id), function()
+        control:destroy()
+      end)
+    end)
+  end)
+end)
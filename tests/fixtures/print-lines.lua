@@ -0,0 +1,5 @@
+-- Prints many lines to a pipe, then exits while they are still buffered
+for i = 1, 10000 do
+  print("line " .. i)
+end
+process:exit(0)
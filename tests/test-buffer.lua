@@ -91,4 +91,127 @@ require('tap')(function (test)
     assert(buf2:toString(3) == 'cd')
     assert(buf2:toString() == 'abcd')
   end)
+
+  test("buffer slices share memory", function()
+    local Buffer = require('buffer').Buffer
+    local buf = Buffer:new('hello world')
+    local word = buf:slice(7, 11)
+    assert(word.length == 5)
+    assert(tostring(word) == 'world')
+    word[1] = string.byte('W')
+    assert(tostring(buf) == 'hello World')
+    local inner = word:subarray(2, 3)
+    assert(tostring(inner) == 'or')
+    assert(buf:slice(3, 2).length == 0)
+    assert(not pcall(buf.slice, buf, 1, 12))
+  end)
+
+  test("buffer copy, fill and concat", function()
+    local Buffer = require('buffer').Buffer
+    local src = Buffer:new('abcdef')
+    local dst = Buffer:new(4)
+    dst:fill(0x2e)
+    assert(tostring(dst) == '....')
+    assert(src:copy(dst, 2, 3) == 3)
+    assert(tostring(dst) == '.cde')
+    -- overlapping copy within one buffer
+    src:copy(src, 3, 1, 4)
+    assert(tostring(src) == 'ababcd')
+    src:fill('xy', 2, 6)
+    assert(tostring(src) == 'axyxyx')
+    local joined = Buffer.concat({ Buffer:new('ab'), 'cd', dst:slice(2, 3) })
+    assert(joined.length == 6)
+    assert(tostring(joined) == 'abcdcd')
+    assert(tostring(Buffer.concat({ 'abc', 'def' }, 4)) == 'abcd')
+  end)
+
+  test("pooled buffers", function()
+    local buffer = require('buffer')
+    local before = buffer.poolStats()
+    local a = buffer.alloc(64)
+    local b = buffer.allocUnsafe(64)
+    for i = 1, 64 do
+      assert(a[i] == 0)
+      b[i] = 0xff
+    end
+    -- Neighbours in a slab don't overlap
+    for i = 1, 64 do
+      assert(a[i] == 0)
+    end
+    local big = buffer.allocUnsafe(64 * 1024)
+    assert(big.length == 64 * 1024)
+    local after = buffer.poolStats()
+    assert(after.hits + after.misses == before.hits + before.misses + 3)
+    assert(after.hits >= before.hits + 1)
+    assert(after.hitRate > 0 and after.hitRate < 1)
+  end)
+
+  test("alloc(0) before any other pooled buffer", function(expect)
+    -- Needs a process where the pool has no slab yet
+    local uv = require('uv')
+    local spawn = require('childprocess').spawn
+    local script = require('path').join(module.dir, 'fixtures', 'buffer-alloc-zero.lua')
+    local child = spawn(uv.exepath(), { script })
+    child:on('exit', expect(function(code)
+      assert(code == 0)
+    end))
+  end)
+
+  test("alloc rejects bad lengths", function()
+    local buffer = require('buffer')
+    assert(not pcall(buffer.allocUnsafe, -1))
+    assert(not pcall(buffer.alloc, "8"))
+    assert(not pcall(buffer.alloc))
+  end)
+
+  test("pool release after a partial read", function()
+    local buffer = require('buffer')
+    local Readable = require('stream').Readable
+    local pool = buffer.Pool:new(16)
+    local buf = pool:get()
+    buf:fill('a')
+    local stream = Readable:new()
+    stream._read = function () end
+    stream:push(buf:slice(1, 10))
+    local head = stream:read(4)
+    local rest = stream:read(6)
+    assert(tostring(head) == 'aaaa' and tostring(rest) == 'aaaaaa')
+    pool:release(head)
+    assert(#pool.free == 1 and pool.free[1] == buf)
+    -- Releasing again must not hand the same memory out twice
+    pool:release(rest)
+    pool:release(buf)
+    assert(#pool.free == 1)
+    assert(pool:get() == buf)
+    assert(pool:get() ~= buf)
+  end)
+
+  test("64-bit and floating point accessors", function()
+    local ffi = require('ffi')
+    local Buffer = require('buffer').Buffer
+    local buf = Buffer:new(9)
+
+    buf:writeDoubleBE(2, 1.5)
+    assert(buf:toString(2, 9) == '\63\248\0\0\0\0\0\0')
+    assert(buf:readDoubleBE(2) == 1.5)
+    buf:writeDoubleLE(1, -0.25)
+    assert(buf:readDoubleLE(1) == -0.25)
+
+    buf:writeFloatLE(3, 0.5)
+    assert(buf:toString(3, 6) == '\0\0\0\63')
+    assert(buf:readFloatLE(3) == 0.5)
+    buf:writeFloatBE(3, 0.5)
+    assert(buf:readFloatBE(3) == 0.5)
+
+    buf:writeUInt64BE(1, 0x0001020304050607)
+    assert(buf:toString(1, 8) == '\0\1\2\3\4\5\6\7')
+    assert(buf:readUInt64BE(1) == ffi.new('uint64_t', 0x0001020304050607))
+    assert(tostring(buf:readUInt64LE(1)) == '506097522914230528ULL')
+    buf:writeInt64LE(2, -2)
+    assert(buf:readInt64LE(2) == ffi.new('int64_t', -2))
+    assert(buf:readUInt8(9) == 0xff)
+
+    assert(not pcall(buf.readDoubleLE, buf, 3))
+    assert(not pcall(buf.writeUInt32BE, buf, 0, 1))
+  end)
 end)
@@ -0,0 +1,98 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local uv = require('uv')
+local net = require('net')
+local timer = require('timer')
+local cluster = require('cluster')
+
+require('tap')(function(test)
+  test("cluster restarts workers and shuts them down", function(expect)
+    if require('ffi').os == 'Windows' then return end
+    local host = '127.0.0.1'
+    local port, controlPort = 10110, 10111
+    local script = require('path').join(module.dir, 'fixtures', 'cluster-worker.lua')
+
+    local ready = {} -- worker id -> times it reported listening
+    local exits = 0
+    local control
+
+    local function served(callback)
+      local client
+      client = net.createConnection(port, host, function()
+        client:on('data', function(data)
+          callback(tonumber(data))
+        end)
+        client:on('end', function()
+          client:destroy()
+        end)
+      end)
+    end
+
+    local function shutdown()
+      -- A real SIGTERM to the master is passed on to every worker
+      uv.kill(process.pid, 'sigterm')
+    end
+
+    local function onReady(id)
+      ready[id] = (ready[id] or 0) + 1
+      if ready[1] == 1 and ready[2] == 1 then
+        -- Both workers serve the shared port, take one of them down
+        served(expect(function(id)
+          assert(id == 1 or id == 2)
+          cluster.workers[1]:kill()
+        end))
+      elseif ready[1] == 2 then
+        -- The killed worker was started again
+        served(expect(function(id)
+          assert(id == 1 or id == 2)
+          shutdown()
+        end))
+      end
+    end
+
+    cluster:on('exit', function(worker, code, signal)
+      exits = exits + 1
+      assert(signal ~= 0 or code ~= 0)
+      if exits == 1 then
+        assert(worker.id == 1)
+      elseif exits == 3 then
+        -- Nothing is restarted after the shutdown
+        timer.setTimeout(200, expect(function()
+          assert(next(cluster.workers) == nil)
+          assert(ready[1] == 2 and ready[2] == 1)
+          cluster:removeAllListeners('exit')
+          control:close()
+        end))
+      end
+    end)
+
+    control = net.createServer(function(socket)
+      socket:on('data', function(data)
+        onReady(tonumber(data))
+      end)
+      socket:on('end', function()
+        socket:destroy()
+      end)
+    end)
+    control:listen(controlPort, host, expect(function()
+      cluster.setup({ exec = uv.exepath(), args = { script } })
+      cluster.run({ workers = 2 })
+    end))
+  end)
+end)
@@ -0,0 +1,112 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License")
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local fs = require('fs')
+local Path = require('path')
+local timer = require('timer')
+
+require('tap')(function(test)
+  test('file cache hits', function(expect)
+    local fn = Path.join(module.dir, 'file-cache.txt')
+    fs.writeFileSync(fn, 'hello cache\n')
+    local cache = fs.FileCache:new()
+    cache:open(fn, expect(function(err, file)
+      assert(not err, err)
+      assert(file.content == 'hello cache\n')
+      assert(file.stat.size == 12)
+      assert(file.etag)
+      cache:release(file)
+      cache:readFile(fn, expect(function(err, data)
+        assert(not err, err)
+        assert(data == 'hello cache\n')
+        local stats = cache:stats()
+        assert(stats.hits == 1 and stats.misses == 1)
+        cache:close()
+        fs.unlinkSync(fn)
+      end))
+    end))
+  end)
+
+  test('file cache keeps fds of large files', function(expect)
+    local fn = Path.join(module.dir, 'file-cache-large.txt')
+    local data = string.rep('x', 1000)
+    fs.writeFileSync(fn, data)
+    local cache = fs.FileCache:new({ maxContentSize = 100 })
+    cache:open(fn, expect(function(err, file)
+      assert(not err, err)
+      assert(file.fd and not file.content)
+      local fd = file.fd
+      cache:invalidate(fn)
+      -- Still in use, so still open
+      assert(file.fd == fd)
+      cache:release(file)
+      assert(file.fd == nil)
+      fs.unlinkSync(fn)
+    end))
+  end)
+
+  test('file cache evicts the least recently used', function(expect)
+    local names = {}
+    for i = 1, 3 do
+      names[i] = Path.join(module.dir, 'file-cache-' .. i .. '.txt')
+      fs.writeFileSync(names[i], tostring(i))
+    end
+    local cache = fs.FileCache:new({ max = 2, watch = false })
+    local function openAll(i)
+      if i > 3 then
+        assert(cache.count == 2)
+        assert(not cache.entries[names[1]])
+        cache:close()
+        for j = 1, 3 do fs.unlinkSync(names[j]) end
+        return
+      end
+      cache:open(names[i], expect(function(err, file)
+        assert(not err, err)
+        cache:release(file)
+        openAll(i + 1)
+      end))
+    end
+    openAll(1)
+  end)
+
+  test('file cache drops changed files', function(expect)
+    local fn = Path.join(module.dir, 'file-cache-change.txt')
+    fs.writeFileSync(fn, 'before')
+    local cache = fs.FileCache:new()
+    cache:open(fn, expect(function(err, file)
+      assert(not err, err)
+      cache:release(file)
+      fs.writeFileSync(fn, 'after')
+      local tries = 0
+      local function check()
+        tries = tries + 1
+        if cache.entries[fn] and tries < 100 then
+          return timer.setTimeout(10, check)
+        end
+        assert(not cache.entries[fn], "not invalidated")
+        cache:readFile(fn, expect(function(err, data)
+          assert(not err, err)
+          assert(data == 'after')
+          cache:close()
+          fs.unlinkSync(fn)
+        end))
+      end
+      check()
+    end))
+  end)
+end)
@@ -0,0 +1,82 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License")
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local fs = require('fs')
+local Buffer = require('buffer').Buffer
+
+require('tap')(function(test)
+  if require('ffi').os == 'Windows' then return end
+
+  test('mmap a file', function(expect)
+    local contents = fs.readFileSync(module.path)
+    local map = assert(fs.mmapSync(module.path))
+    assert(Buffer.isBuffer(map))
+    assert(map.length == #contents)
+    assert(tostring(map) == contents)
+    assert(tostring(map:slice(1, 10)) == contents:sub(1, 10))
+    assert(map.readOnly)
+    fs.mmap(module.path, expect(function(err, map2)
+      assert(not err, err)
+      assert(tostring(map2) == contents)
+    end))
+  end)
+
+  test('writing to a mapped buffer errors', function()
+    local contents = fs.readFileSync(module.path)
+    local map = assert(fs.mmapSync(module.path))
+    local view = map:slice(1, 10)
+    local other = Buffer:new("0123456789")
+    local attempts = {
+      function () map[1] = 0 end,
+      function () map:writeUInt8(1, 0) end,
+      function () map:writeUInt32LE(1, 0) end,
+      function () map:fill(0) end,
+      function () other:copy(map) end,
+      function () view[1] = 0 end,
+      function () view:fill("x") end,
+    }
+    for k = 1, #attempts do
+      local ok, err = pcall(attempts[k])
+      assert(not ok, "write " .. k .. " succeeded")
+      assert(err:find("read%-only"), err)
+    end
+    -- Reading and copying out of the mapping still work
+    assert(map:copy(other) == 10)
+    assert(tostring(other) == contents:sub(1, 10))
+    assert(tostring(map) == contents)
+  end)
+
+  test('mmap read stream', function(expect)
+    local contents = fs.readFileSync(module.path)
+    local stream = fs.createReadStream(module.path, {
+      mmap = true,
+      chunkSize = 100,
+      offset = 5,
+      length = 1000,
+    })
+    local parts = {}
+    stream:on('data', function(chunk)
+      assert(Buffer.isBuffer(chunk))
+      assert(chunk.length <= 100)
+      parts[#parts + 1] = tostring(chunk)
+    end)
+    stream:on('end', expect(function()
+      assert(table.concat(parts) == contents:sub(6, 1005))
+    end))
+  end)
+end)
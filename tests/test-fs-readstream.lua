@@ -115,4 +115,26 @@ proident, sunt in culpa qui officia deserunt mollit anim id est laborum.]]
     fp:once('end', expect(onEnd))
     fp:pipe(sink)
   end)
+
+  test('fs.readstream read ahead', function(expect)
+    local tmp_file = path.join(module.dir, 'test_readstream4.txt')
+    fs.writeFileSync(tmp_file, string.rep(text, 20))
+
+    local options = {
+      offset = 7,
+      chunkSize = 64,
+      maxChunkSize = 1024,
+      readAhead = 4,
+    }
+
+    local chunks = {}
+    local fp = fs.createReadStream(tmp_file, options)
+    fp:on('data', function(chunk)
+      chunks[#chunks + 1] = chunk
+    end)
+    fp:once('end', expect(function()
+      assert(table.concat(chunks) == string.sub(string.rep(text, 20), 8))
+      fs.unlinkSync(tmp_file)
+    end))
+  end)
 end)
@@ -38,6 +38,80 @@ require('tap')(function (test)
     stream:on('finish', expect(onFinish))
   end)
 
+  test("writefile stream coalesces writes", function(expect)
+    local filePath = path.join(module.dir, 'testFileCoalesce.txt')
+    pcall(fs.unlinkSync, filePath)
+    local stream = fs.createWriteStream(filePath, { coalesceDelay = 10 })
+    local writes = 0
+    local write, writev = stream._write, stream._writev
+    stream._write = function(...)
+      writes = writes + 1
+      return write(...)
+    end
+    stream._writev = function(...)
+      writes = writes + 1
+      return writev(...)
+    end
+    local lines = {}
+    stream:once('open', expect(function()
+      for i = 1, 100 do
+        lines[i] = "line " .. i .. "\n"
+        stream:write(lines[i])
+      end
+      stream:_end()
+    end))
+    stream:on('finish', expect(function()
+      local fileData = fs.readFileSync(filePath)
+      pcall(fs.unlinkSync, filePath)
+      assert(writes == 1)
+      assert(fileData == table.concat(lines))
+    end))
+  end)
+
+  test("writefile stream syncs", function(expect)
+    local filePath = path.join(module.dir, 'testFileSync.txt')
+    pcall(fs.unlinkSync, filePath)
+    local fdatasync = fs.fdatasync
+    local syncs = 0
+    fs.fdatasync = function(...)
+      syncs = syncs + 1
+      return fdatasync(...)
+    end
+    local stream = fs.createWriteStream(filePath, { syncBytes = 10 })
+    stream:write("0123456789", expect(function()
+      assert(syncs == 1)
+      stream:write("abc")
+      stream:_end()
+    end))
+    stream:on('finish', expect(function()
+      fs.fdatasync = fdatasync
+      assert(fs.readFileSync(filePath) == "0123456789abc")
+      pcall(fs.unlinkSync, filePath)
+    end))
+  end)
+
+  test("writefile stream sync failure reaches the writer", function(expect)
+    local filePath = path.join(module.dir, 'testFileSyncFail.txt')
+    pcall(fs.unlinkSync, filePath)
+    local fdatasync = fs.fdatasync
+    fs.fdatasync = function(_, callback)
+      callback("EIO: i/o error")
+    end
+    local stream = fs.createWriteStream(filePath, { syncBytes = 1 })
+    local errors = 0
+    stream:on('error', function(err)
+      errors = errors + 1
+      assert(err == "EIO: i/o error")
+    end)
+    stream:write("data", expect(function(err)
+      fs.fdatasync = fdatasync
+      assert(err == "EIO: i/o error")
+      assert(errors <= 1)
+      stream:close()
+      pcall(fs.unlinkSync, filePath)
+    end))
+  end)
+
   -- enable test with stderr pipe is added
   --test("writefile stream fd", function(expect)
   --  local stream, data, onFinish
@@ -66,4 +66,16 @@ require('tap')(function(test)
       end)
     end)
   end)
+
+  test('write buffers', function()
+    local Buffer = require('buffer').Buffer
+    local fn3 = Path.join(module.dir, 'write3.txt')
+    local fd = FS.openSync(fn3, 'w')
+    local whole = Buffer:new('hello buffers')
+    assert(FS.writeSync(fd, 0, whole) == 13)
+    assert(FS.writeSync(fd, 13, { '!', whole:slice(6, 6) }) == 2)
+    FS.closeSync(fd)
+    assert(FS.readFileSync(fn3) == 'hello buffers! ')
+    FS.unlinkSync(fn3)
+  end)
 end)
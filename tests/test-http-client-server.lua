@@ -17,6 +17,7 @@ limitations under the License.
 --]]
 
 local http = require('http')
+local fs = require('fs')
 
 local HOST = "127.0.0.1"
 local PORT = process.env.PORT or 10082
@@ -56,4 +57,81 @@ require('tap')(function(test)
       req:done()
     end)
   end)
+
+  test("http response is written once", function(expect)
+    local server = nil
+    local writes = 0
+
+    server = http.createServer(function(request, response)
+      local socket = response.socket
+      local write = socket._write
+      socket._write = function(self, data, callback)
+        writes = writes + 1
+        return write(self, data, callback)
+      end
+      response:setHeader("Content-Type", "text/plain")
+      response:write("Hello ")
+      response:finish("world\n")
+    end)
+
+    server:listen(PORT, HOST, function()
+      http.get({
+        host = HOST,
+        port = PORT,
+        path = "/",
+      }, expect(function(response)
+        local data = ""
+        response:on('data', function(chunk)
+          data = data .. chunk
+        end)
+        response:on('end', expect(function()
+          assert(data == "Hello world\n")
+          assert(writes == 1)
+          server:close()
+        end))
+      end))
+    end)
+  end)
+
+  test("http sendFile with range", function(expect)
+    local path = module.path
+    local contents = fs.readFileSync(path)
+    local server
+
+    server = http.createServer(function(request, response)
+      response:sendFile(path, expect(function(err)
+        assert(not err, err)
+      end))
+    end)
+
+    local function get(headers, callback)
+      http.get({
+        host = HOST,
+        port = PORT,
+        path = "/",
+        headers = headers,
+      }, function(response)
+        local data = ""
+        response:on('data', function(chunk)
+          data = data .. chunk
+        end)
+        response:on('end', function()
+          callback(response, data)
+        end)
+      end)
+    end
+
+    server:listen(PORT, HOST, function()
+      get({}, expect(function(response, data)
+        assert(response.statusCode == 200)
+        assert(data == contents)
+        get({{"Range", "bytes=10-19"}}, expect(function(response, data)
+          assert(response.statusCode == 206)
+          assert(response.headers["content-range"] == "bytes 10-19/" .. #contents)
+          assert(data == contents:sub(11, 20))
+          server:close()
+        end))
+      end))
+    end)
+  end)
 end)
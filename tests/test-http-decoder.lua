@@ -91,6 +91,37 @@ require('tap')(function (test)
   end)
 
 
+  test("http server parser with head split across many reads", function ()
+    local head = "GET /path HTTP/1.1\r\nUser-Agent: Luvit-Test\r\nX-Long: " ..
+      string.rep("x", 2000) .. "\r\n\r\n"
+    local inputs = {}
+    for i = 1, #head, 3 do
+      inputs[#inputs + 1] = head:sub(i, i + 2)
+    end
+    local output = testDecoder(decoder, inputs)
+    assert(deepEqual({
+      { method = "GET", path = "/path", version = 1.1, keepAlive = true,
+        {"User-Agent", "Luvit-Test"},
+        {"X-Long", string.rep("x", 2000)},
+      },
+      ""
+    }, output))
+  end)
+
+  test("http client parser with terminator split across reads", function ()
+    local output = testDecoder(decoder, {
+      "HTTP/1.1 204 No Content\r\nServer: Luvit\r\n\r",
+      "\n",
+    })
+    p(output)
+    assert(deepEqual({
+      { code = 204, reason = "No Content", version = 1.1, keepAlive = true,
+        {"Server", "Luvit"}
+      },
+      ""
+    }, output))
+  end)
+
   test("http 1.0 Keep-Alive", function ()
     local output = testDecoder(decoder, {
       "GET / HTTP/1.0\r\n",
@@ -242,4 +273,47 @@ require('tap')(function (test)
     }, output))
   end)
 
+  test("decoding by index", function ()
+    local decode = decoder()
+    local chunk = "GET /a HTTP/1.1\r\n\r\n" ..
+      "PUT /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nHello" ..
+      "PUT /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nWor"
+    local outputs = {}
+    local index = 1
+    while true do
+      local event, nextIndex = decode(chunk, index)
+      if not event then
+        -- The decoder knows how much of the chunk it is waiting for
+        assert(nextIndex == 10)
+        break
+      end
+      outputs[#outputs + 1] = event
+      index = nextIndex
+    end
+    chunk = chunk:sub(index) .. "ld\r\n0\r\n\r\n"
+    index = 1
+    while true do
+      local event, nextIndex = decode(chunk, index)
+      if not event then break end
+      outputs[#outputs + 1] = event
+      index = nextIndex
+    end
+    p(outputs)
+    assert(index == #chunk + 1)
+    assert(deepEqual({
+      { method = "GET", path = "/a", version = 1.1, keepAlive = true },
+      "",
+      { method = "PUT", path = "/b", version = 1.1, keepAlive = true,
+        {"Content-Length", "5"},
+      },
+      "Hello",
+      "",
+      { method = "PUT", path = "/c", version = 1.1, keepAlive = true,
+        {"Transfer-Encoding", "chunked"},
+      },
+      "World",
+      "",
+    }, outputs))
+  end)
+
 end)
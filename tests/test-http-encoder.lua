@@ -115,6 +115,24 @@ require('tap')(function (test)
     }, output))
   end)
 
+  test("server encoder - repeated headers", function ()
+    local inputs = {}
+    local expected = {}
+    for i = 1, 20 do
+      inputs[#inputs + 1] = { code = 200,
+        {"Server", "Luvit"},
+        {"X-Request", i},
+        {"X-Broken", "a\r\nb"},
+        {"Content-Length", 0},
+      }
+      expected[#expected + 1] = "HTTP/1.1 200 OK\r\nServer: Luvit\r\n" ..
+        "X-Request: " .. i .. "\r\nX-Broken: a b\r\nContent-Length: 0\r\n\r\n"
+    end
+    local output = testEncoder(encoder, inputs)
+    p(output)
+    assert(deepEqual(expected, output))
+  end)
+
   test("client encoder", function ()
     local output = testEncoder(encoder, {
       { method = "GET", path = "/my-resource",
@@ -0,0 +1,84 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local codec = require('http-codec')
+local deepEqual = require('deep-equal')
+local env = require('env')
+
+-- Built with `make native`, `make test-native` insists on it being there
+local function hasNative()
+  if codec.hasNative then return true end
+  assert(not env.get('LUVIT_REQUIRE_NATIVE'), "native httpparser is not installed")
+  print("native httpparser is not installed, skipping")
+  return false
+end
+
+local messages = {
+  "GET /path HTTP/1.1\r\nUser-Agent: Luvit-Test\r\nHost: a\r\n\r\n",
+  "POST /form HTTP/1.0\r\nContent-Length: 5\r\nConnection: keep-alive\r\n\r\nhello",
+  "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+  "HTTP/1.1 404 Not Found\nContent-Length: 0\nX-Empty:\n\n",
+  "GET / HTTP/1.1\r\nbroken header\r\nHost: b\r\n\r\n",
+}
+
+-- Decode data handed over in pieces of at most step bytes, keeping the
+-- unconsumed data and appending to it as the decoder requires
+local function decodeAll(options, data, step)
+  local decode = codec.decoder(options)
+  local outputs = {}
+  local chunk, index, offset = "", 1, 1
+  while true do
+    local event, nextIndex = decode(chunk, index)
+    if event then
+      outputs[#outputs + 1] = event
+      index = nextIndex
+    else
+      if offset > #data then break end
+      chunk = chunk:sub(index) .. data:sub(offset, offset + step - 1)
+      index = 1
+      offset = offset + step
+    end
+  end
+  return outputs
+end
+
+require('tap')(function (test)
+
+  test("native parser matches the lua parser", function ()
+    if not hasNative() then return end
+    for _, message in ipairs(messages) do
+      for step = 1, #message do
+        local native = decodeAll({ native = true }, message, step)
+        local lua = decodeAll({ native = false }, message, step)
+        assert(deepEqual(lua, native), message)
+      end
+    end
+  end)
+
+  test("native parser starts over unless resumed", function ()
+    if not hasNative() then return end
+    local parser = require('httpparser').new()
+    assert(parser:parse("GET /first HTTP/1.1\r\nX-Long-Header: 1") == nil)
+    -- A different, longer buffer is a new head, not the tail of the old one
+    local head = parser:parse("POST /second HTTP/1.1\r\nHost: b\r\n\r\n")
+    assert(head.method == "POST" and head.path == "/second")
+    assert(parser:parse("GET / HTTP/1.1\r\n") == nil)
+    head = parser:parse("GET / HTTP/1.1\r\nHost: c\r\n\r\n", 1, true)
+    assert(head.method == "GET" and head[1][2] == "c")
+  end)
+end)
@@ -0,0 +1,119 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License")
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local fs = require('fs')
+local Path = require('path')
+local json = require('json')
+local log = require('log')
+
+require('tap')(function(test)
+  test('log lines with fields', function(expect)
+    local path = Path.join(module.dir, 'test-log.log')
+    pcall(fs.unlinkSync, path)
+    local logger = log.new({ path = path, fields = { app = "test" } })
+    for i = 1, 1000 do
+      logger:info("line", { n = i })
+    end
+    logger:debug("not written")
+    logger:child({ id = 7 }):warn("two words", { note = "a b" })
+    logger:close(expect(function()
+      local data = fs.readFileSync(path)
+      local lines = {}
+      for line in data:gmatch("[^\n]+") do
+        lines[#lines + 1] = line
+      end
+      assert(#lines == 1001)
+      assert(lines[1]:find(" INFO line app=test n=1$"))
+      assert(lines[1000]:find(" INFO line app=test n=1000$"))
+      assert(lines[1001]:find(' WARN two words app=test id=7 note="a b"$'))
+      fs.unlinkSync(path)
+    end))
+  end)
+
+  test('log json lines', function(expect)
+    local path = Path.join(module.dir, 'test-log-json.log')
+    pcall(fs.unlinkSync, path)
+    local logger = log.new({ path = path, format = "json" })
+    logger:error("failed", { code = 42 })
+    logger:close(expect(function()
+      local record = json.parse(fs.readFileSync(path))
+      assert(record.level == "error")
+      assert(record.msg == "failed")
+      assert(record.code == 42)
+      fs.unlinkSync(path)
+    end))
+  end)
+
+  test('log rotation', function(expect)
+    local path = Path.join(module.dir, 'test-log-rotate.log')
+    for _, name in ipairs({ path, path .. ".1", path .. ".2" }) do
+      pcall(fs.unlinkSync, name)
+    end
+    local logger = log.new({ path = path, maxSize = 100, maxFiles = 2 })
+    local function writeBatch(i, done)
+      if i > 3 then return done() end
+      logger:info(string.rep("x", 80))
+      logger:flush(function(err)
+        assert(not err, err)
+        writeBatch(i + 1, done)
+      end)
+    end
+    writeBatch(1, expect(function()
+      logger:close(expect(function()
+        assert(fs.existsSync(path .. ".1"))
+        assert(fs.existsSync(path .. ".2"))
+        -- Each batch went to a fresh file
+        local _, lines = fs.readFileSync(path):gsub("\n", "")
+        assert(lines == 1)
+        for _, name in ipairs({ path, path .. ".1", path .. ".2" }) do
+          fs.unlinkSync(name)
+        end
+      end))
+    end))
+  end)
+
+  test('flushSync with a write in flight', function(expect)
+    local path = Path.join(module.dir, 'test-log-sync.log')
+    pcall(fs.unlinkSync, path)
+    local logger = log.new({ path = path })
+    for i = 1, 100 do
+      logger:info("line", { n = i })
+    end
+    -- The first 100 lines are on their way when the exit path runs
+    logger:flush(expect(function()
+      local n = 0
+      for value in fs.readFileSync(path):gmatch("n=(%d+)") do
+        n = n + 1
+        assert(tonumber(value) == n)
+      end
+      assert(n == 200)
+      logger:close(expect(function()
+        fs.unlinkSync(path)
+      end))
+    end))
+    for i = 101, 200 do
+      logger:info("line", { n = i })
+    end
+    logger:flushSync()
+  end)
+
+  test('unknown level option', function()
+    local ok, err = pcall(log.new, { level = "verbose" })
+    assert(not ok and err:find("Unknown log level verbose"))
+  end)
+end)
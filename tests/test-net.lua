@@ -156,4 +156,270 @@ require('tap')(function (test)
     server = net.createServer(onClient)
     server:listen(port, host, expect(onListen))
   end)
+
+  test("reusePort servers", function(expect)
+    if require('ffi').os == 'Windows' then return end
+    local port = 10085
+    local host = '127.0.0.1'
+    local server1, server2
+
+    local function onClient(client)
+      client:pipe(client)
+    end
+
+    server1 = net.createServer({ reusePort = true }, onClient)
+    server1:listen(port, host, expect(function()
+      -- Too late once the server has its socket
+      assert(not pcall(server1.listen, server1,
+        { port = port + 100, host = host, reusePort = true }))
+      -- A second socket can bind the same address
+      server2 = net.createServer(onClient)
+      server2:listen({ port = port, host = host, reusePort = true }, expect(function()
+        local client
+        client = net.createConnection(port, host, expect(function()
+          client:on('data', expect(function(data)
+            assert(data == 'hello')
+            client:destroy()
+            server1:close()
+            server2:close()
+          end))
+          client:write('hello')
+        end))
+      end))
+    end))
+  end)
+
+  test("corked writes use writev", function(expect)
+    local port = 10086
+    local host = '127.0.0.1'
+    local server, client
+    local writevs = 0
+
+    server = net.createServer(function(socket)
+      local received = ''
+      local onDone = expect(function()
+        assert(received == 'head,body,trailer')
+        assert(writevs == 1)
+        socket:destroy()
+        client:destroy()
+        server:close()
+      end)
+      socket:on('data', function(data)
+        received = received .. data
+        if #received >= 17 then onDone() end
+      end)
+    end)
+    server:listen(port, host, expect(function()
+      client = net.createConnection(port, host, expect(function()
+        local writev = client._writev
+        client._writev = function(self, requests, callback)
+          writevs = writevs + 1
+          assert(#requests == 3)
+          return writev(self, requests, callback)
+        end
+        client:cork()
+        client:write('head,')
+        client:write('body,')
+        client:write('trailer')
+        client:uncork()
+      end))
+    end))
+  end)
+
+  test("write buffers", function(expect)
+    local Buffer = require('buffer').Buffer
+    local port = 10092
+    local host = '127.0.0.1'
+    local server, client
+
+    server = net.createServer(function(socket)
+      local received = ''
+      socket:on('data', function(data)
+        received = received .. data
+        if #received >= 32 then
+          assert(received == 'binary blob as a list and corked')
+          socket:destroy()
+          client:destroy()
+          server:close()
+        end
+      end)
+    end)
+    server:listen(port, host, expect(function()
+      client = net.createConnection(port, host, expect(function()
+        local blob = Buffer:new('binary blob')
+        client:write(blob:slice(1, 7), expect(function(err)
+          assert(not err)
+        end))
+        client:write(blob:slice(8))
+        client:write({ ' as', Buffer:new(' a list') })
+        -- Corked writes reach _writev, with a list among the chunks
+        client:cork()
+        client:write({ ' and', ' ' })
+        client:write(Buffer:new('corked'))
+        client:uncork()
+      end))
+    end))
+  end)
+
+  test("write buffers without string copies", function(expect)
+    if require('ffi').os == 'Windows' then return end
+    local Buffer = require('buffer').Buffer
+    local port = 10100
+    local host = '127.0.0.1'
+    local size = 1024 * 1024
+    local server, client
+
+    -- Count every Lua string made out of a Buffer while the writes run
+    local copies = 0
+    local tostringBuffer = Buffer.meta.__tostring
+    Buffer.meta.__tostring = function(self)
+      copies = copies + 1
+      return tostringBuffer(self)
+    end
+
+    server = net.createServer(function(socket)
+      local received = 0
+      socket:on('data', function(data)
+        received = received + #data
+      end)
+      socket:on('end', expect(function()
+        assert(received == size + 10)
+        socket:destroy()
+        server:close()
+      end))
+    end)
+    server:listen(port, host, expect(function()
+      client = net.createConnection(port, host, expect(function()
+        local big = Buffer:new(size)
+        big:fill('z')
+        -- Large enough to fill the socket and wait for it to drain
+        client:write(big, expect(function(err)
+          assert(not err)
+        end))
+        client:write({ 'head', Buffer:new('buffer') }, expect(function(err)
+          assert(not err)
+          Buffer.meta.__tostring = tostringBuffer
+          assert(copies == 0)
+          client:shutdown()
+        end))
+      end))
+    end))
+  end)
+
+  test("readInto buffer pool", function(expect)
+    if require('ffi').os == 'Windows' then return end
+    local buffer = require('buffer')
+    local pool = buffer.Pool:new(16)
+    local port = 10093
+    local host = '127.0.0.1'
+    local server, client
+
+    server = net.createServer(function(socket)
+      local received = {}
+      socket:readInto(pool)
+      socket:on('data', function(chunk)
+        assert(buffer.Buffer.isBuffer(chunk))
+        assert(chunk.length <= 16)
+        received[#received + 1] = tostring(chunk)
+        pool:release(chunk)
+      end)
+      socket:on('end', expect(function()
+        assert(table.concat(received) == string.rep('0123456789', 5))
+        assert(#pool.free > 0)
+        socket:destroy()
+        server:close()
+      end))
+    end)
+    server:listen(port, host, expect(function()
+      client = net.createConnection(port, host, expect(function()
+        client:write(string.rep('0123456789', 5), function()
+          client:shutdown(function()
+            client:destroy()
+          end)
+        end)
+      end))
+    end))
+  end)
+
+  local function testPipeSockets(name, port, options)
+    test(name, function(expect)
+      local host = '127.0.0.1'
+      local upstream, proxy, client
+
+      upstream = net.createServer(function(socket)
+        socket:pipe(socket)
+      end)
+      proxy = net.createServer(function(socket)
+        socket:pause()
+        local remote
+        remote = net.createConnection(port, host, function()
+          local pipe = net.pipeSockets(socket, remote, options)
+          pipe:on('close', expect(function()
+            assert(pipe.bytesAtoB == 4)
+            assert(pipe.bytesBtoA == 4)
+            upstream:close()
+            proxy:close()
+          end))
+        end)
+      end)
+
+      upstream:listen(port, host, expect(function()
+        proxy:listen(port + 1, host, expect(function()
+          client = net.createConnection(port + 1, host, expect(function()
+            client:on('data', expect(function(data)
+              assert(data == 'ping')
+              client:destroy()
+            end))
+            client:write('ping')
+          end))
+        end))
+      end))
+    end)
+  end
+
+  testPipeSockets("pipeSockets", 10094)
+  testPipeSockets("pipeSockets without splice", 10096, { splice = false })
+
+  test("pipeSockets without splice forwards every byte", function(expect)
+    local host = '127.0.0.1'
+    local port = 10098
+    local size = 4 * 1024 * 1024
+    local upstream, proxy, client
+
+    upstream = net.createServer(function(socket)
+      local received = 0
+      socket:on('data', function(chunk)
+        received = received + #chunk
+      end)
+      socket:on('end', expect(function()
+        assert(received == size)
+      end))
+    end)
+    proxy = net.createServer(function(socket)
+      socket:pause()
+      local remote
+      remote = net.createConnection(port, host, function()
+        local pipe = net.pipeSockets(socket, remote, { splice = false })
+        pipe:on('close', expect(function()
+          assert(pipe.bytesAtoB == size)
+          upstream:close()
+          proxy:close()
+        end))
+      end)
+    end)
+
+    upstream:listen(port, host, expect(function()
+      proxy:listen(port + 1, host, expect(function()
+        client = net.createConnection(port + 1, host, expect(function()
+          client:write(string.rep('x', size), function()
+            client:shutdown()
+          end)
+          client:on('end', expect(function()
+            client:destroy()
+          end))
+          client:resume()
+        end))
+      end))
+    end))
+  end)
 end)
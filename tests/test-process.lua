@@ -254,4 +254,22 @@ require('tap')(function(test)
     assert(memory.heapUsed >= 0)
     p(memory)
   end)
+
+  test('buffered print is flushed at exit', function(expect)
+    local script = require('path').join(module.dir, 'fixtures', 'print-lines.lua')
+    local child = spawn(uv.exepath(), { script })
+    local data = {}
+    child.stdout:on('data', function(chunk)
+      data[#data + 1] = chunk
+    end)
+    child.stdout:once('end', expect(function()
+      local output = table.concat(data)
+      local _, lines = output:gsub("\n", "")
+      assert(lines == 10000)
+      assert(output:sub(-11) == "line 10000\n")
+    end))
+    child:on('exit', expect(function(code)
+      assert(code == 0)
+    end))
+  end)
 end)
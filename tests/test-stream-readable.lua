@@ -0,0 +1,79 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+local Readable = require('stream').Readable
+
+local function newReadable()
+  local stream = Readable:new()
+  stream._read = function () end
+  return stream
+end
+
+require('tap')(function (test)
+  test("read small pieces across chunks", function ()
+    local stream = newReadable()
+    stream:push("hello ")
+    stream:push("wor")
+    stream:push("ld\n")
+    assert(stream:read(2) == "he")
+    assert(stream:read(2) == "ll")
+    assert(stream:read(2) == "o ")
+    assert(stream:read(5) == "world")
+    assert(stream._readableState.length == 1)
+    assert(stream:read(1) == "\n")
+    assert(stream._readableState.length == 0)
+  end)
+
+  test("read the rest after a partial read", function ()
+    local stream = newReadable()
+    stream:push("abcdef")
+    stream:push("ghi")
+    assert(stream:read(4) == "abcd")
+    assert(stream:read(5) == "efghi")
+  end)
+
+  test("unshift after a partial read", function ()
+    local stream = newReadable()
+    stream:push("abcdef")
+    assert(stream:read(3) == "abc")
+    stream:unshift("xy")
+    assert(stream:read(4) == "xyde")
+    assert(stream:read(1) == "f")
+  end)
+
+  test("buffer chunks", function ()
+    local Buffer = require('buffer').Buffer
+    local stream = newReadable()
+    stream:push(Buffer:new("hello "))
+    stream:push("world")
+    assert(stream._readableState.length == 11)
+    local head = stream:read(3)
+    assert(Buffer.isBuffer(head) and tostring(head) == "hel")
+    assert(stream:read(5) == "lo wo")
+    assert(stream:read(3) == "rld")
+  end)
+
+  test("object mode", function ()
+    local stream = Readable:new({ objectMode = true })
+    stream._read = function () end
+    stream:push({ 1 })
+    stream:push({ 2 })
+    assert(stream:read()[1] == 1)
+    assert(stream:read()[1] == 2)
+  end)
+end)
@@ -50,6 +50,29 @@ require('tap')(function (test)
     end), 'test3')
   end)
 
+  test("nextTick before setImmediate", function (expect)
+    local order = {}
+    timer.setImmediate(expect(function (a, b, c)
+      assert(a == 1 and b == nil and c == 3)
+      order[#order + 1] = "immediate"
+      assert(table.concat(order, " ") == "tick nested immediate")
+    end), 1, nil, 3)
+    timer.nextTick(function (name)
+      order[#order + 1] = name
+      timer.nextTick(function ()
+        order[#order + 1] = "nested"
+      end)
+    end, "tick")
+    local immediates, ticks = timer.queueDepth()
+    assert(immediates >= 1 and ticks >= 1)
+  end)
+
+  test("cached http date", function ()
+    local now = timer.httpDate()
+    assert(now:match("^%a%a%a, %d%d %a%a%a %d%d%d%d %d%d:%d%d:%d%d GMT$"))
+    assert(timer.httpDate() == now)
+  end)
+
   test('double close', function ()
     local t1 = timer.setTimeout(200, function()
       assert(nil, "Should not get here!")
@@ -57,5 +80,54 @@ require('tap')(function (test)
     timer.clearTimeout(t1)
     timer.clearTimeout(t1)
   end)
-end)
 
+  test("idle timeouts", function (expect)
+    local Emitter = require('core').Emitter
+    local order = {}
+    local function idle(name, msecs)
+      local item = Emitter:new()
+      timer.enroll(item, msecs)
+      timer.active(item)
+      item:on('timeout', function ()
+        order[#order + 1] = name
+      end)
+      return item
+    end
+
+    local rearmed = false
+    local short = idle("short", 10)
+    short:on('timeout', function ()
+      if rearmed then return end
+      rearmed = true
+      timer.active(short)
+    end)
+    local cancelled = idle("cancelled", 20)
+    idle("medium", 50)
+    local long = idle("long", 80)
+    timer.unenroll(cancelled)
+
+    long:on('timeout', expect(function ()
+      assert(table.concat(order, " ") == "short short medium long")
+    end))
+  end)
+
+  test("active postpones idle timeout", function (expect)
+    local uv = require('uv')
+    local item = require('core').Emitter:new()
+    timer.enroll(item, 30)
+    timer.active(item)
+    local last
+    local count = 0
+    local interval
+    interval = timer.setInterval(10, function ()
+      count = count + 1
+      last = uv.now()
+      timer.active(item)
+      if count == 5 then timer.clearInterval(interval) end
+    end)
+    item:on('timeout', expect(function ()
+      assert(count == 5)
+      assert(uv.now() - last >= 30)
+    end))
+  end)
+end)
@@ -0,0 +1,73 @@
+--[[
+
+Copyright 2015 The Luvit Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS-IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+--]]
+
+require('tap')(function (test)
+  local fixture = require('./fixture-tls')
+  local tls = require('tls')
+  local net = require('net')
+
+  -- A plain client talks to a TLS echo server through a proxy that pipes
+  -- its plain socket into a TLS connection.  Splicing would forward the raw
+  -- bytes past TLS, so the echo only comes back when the TLS side streams.
+  test("pipeSockets with a TLS socket", function(expect)
+    local host = '127.0.0.1'
+    local port = 10101
+    local upstream, proxy, client
+
+    upstream = tls.createServer({
+      cert = fixture.certPem,
+      key = fixture.keyPem,
+    }, function(conn, err)
+      if err then return end
+      conn:pipe(conn)
+    end)
+    proxy = net.createServer(function(socket)
+      socket:pause()
+      local remote
+      remote = tls.connect({
+        port = port,
+        host = host,
+        rejectUnauthorized = false,
+      }, function()
+        assert(not pcall(remote.readInto, remote, require('buffer').Pool:new()))
+        local pipe = net.pipeSockets(socket, remote)
+        pipe:on('close', expect(function()
+          assert(pipe.bytesAtoB == 4)
+          assert(pipe.bytesBtoA == 4)
+          upstream:close()
+          proxy:close()
+        end))
+      end)
+    end)
+
+    upstream:listen(port, host, expect(function()
+      proxy:listen(port + 1, host, expect(function()
+        client = net.createConnection(port + 1, host, expect(function()
+          client:on('data', expect(function(data)
+            assert(data == 'ping')
+            client:shutdown()
+          end))
+          client:on('end', expect(function()
+            client:destroy()
+          end))
+          client:write('ping')
+        end))
+      end))
+    end))
+  end)
+end)